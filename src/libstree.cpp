@@ -0,0 +1,114 @@
+#include "stree.h"
+
+#include <iomanip>
+#include <sstream>
+
+void treeFormatter_c::head( const std::string &current, const std::string &prefix,
+                            const std::vector< std::string > &columns, bool isRootNode,
+                            bool hasChildren, bool terminal )
+{
+  const structureStyle_t structureStyle = _options.structureStyle;
+
+  // The root node in graphviz needs special consideration
+  if ( isRootNode && structureStyle == graphviz )
+     _out << "digraph {";
+
+  // Some output formats require that we surround the current string with something:
+  if ( structureStyle == parentheses )
+    _out << "(";
+
+  // print current string, possible repeating the prefix along the way, and decorate the thing with
+  // frequencies.
+  if ( _options.prependFrequency )
+  {
+    for ( std::size_t i = 0; i < columns.size(); ++i )
+    {
+      if ( i )
+        _out << " ";
+      if ( structureStyle == linewise ) // neat vertical alignment
+        _out << std::setw( 8 ) << std::left;
+      _out << columns[ i ];
+    }
+    if ( !current.empty() )
+       _out << " ";
+  }
+
+  if ( _options.repeatPrefix )
+    _out << prefix << current;
+  else if ( structureStyle == linewise )
+    // Use whitespace instead
+    _out << std::string( prefix.length(), ' ' ) << current;
+  else
+    _out << current;
+
+  if ( _options.appendFrequency )
+  {
+    if ( !current.empty() || _options.prependFrequency )
+      _out << " ";
+    for ( std::size_t i = 0; i < columns.size(); ++i )
+      _out << ( i ? " " : "" ) << columns[ i ];
+  }
+
+  if ( structureStyle == linewise )
+    _out << "\n";
+
+  if ( hasChildren )
+  {
+    if ( structureStyle == graphviz && !current.empty() )
+      _out << " -> {";
+    // bash output compresses "foo foolish" to "foo{,lish}".
+    if ( structureStyle == bash )
+      _out << ( terminal ? "{," : "{" );
+  }
+}
+
+void treeFormatter_c::separator()
+{
+  if ( _options.structureStyle == graphviz )
+    _out << ";";
+  else if ( _options.structureStyle == bash )
+    _out << ",";
+}
+
+void treeFormatter_c::tail( const std::string &current, bool isRootNode, bool hasChildren )
+{
+  const structureStyle_t structureStyle = _options.structureStyle;
+  if ( hasChildren && ( ( structureStyle == graphviz && !current.empty() ) ||
+                        structureStyle == bash ) )
+    _out << "}";
+
+  if ( structureStyle == parentheses )
+    _out << ")";
+  if ( isRootNode )
+  {
+    if ( structureStyle == graphviz )
+      _out << "}";
+    _out << "\n";
+  }
+}
+
+std::vector< std::string > formattingVisitor_c::columns( unsigned long long count ) const
+{
+  std::ostringstream text;
+  text << count;
+  return std::vector< std::string >( 1, text.str() );
+}
+
+void formattingVisitor_c::enter( const std::string &current, const std::string &prefix,
+                                 unsigned long long count, unsigned long long terminal,
+                                 std::size_t children )
+{
+  if ( !_open.empty() && _open.back().second++ )
+    _formatter.separator();
+  _formatter.head( current, prefix,
+                   _options.printFrequency() ? columns( count ) : std::vector< std::string >(),
+                   _open.empty(), children > 0, terminal > 0 );
+  _open.push_back( std::make_pair( children > 0, 0 ) );
+}
+
+void formattingVisitor_c::leave( const std::string &current, const std::string & )
+{
+  const bool hasChildren = _open.back().first;
+  _open.pop_back();
+  _formatter.tail( current, _open.empty(), hasChildren );
+}
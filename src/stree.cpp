@@ -1,16 +1,43 @@
 #include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <limits>
 #include <map>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <random>
+#include <set>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
-static bool printFrequency = true;
-static bool printPrefix = true;
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "stree.h"
 
 void usage()
 {
@@ -19,7 +46,23 @@ void usage()
     "  stree - Build and display a prefix trie from a list of strings\n"
     "\n"
     "SYNOPSIS\n"
-    "  stree [-a] [-s] [-p] [-f] [-F] file\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] [--distinct-field N] [--memory-cap SIZE] file\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] --count-min SIZE [--count-min-depths LIST] file\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] --sample RATE [--sample-ci] [--seed N] file\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] --window SECONDS [--window-buckets N]\n"
+    "        [--time-field N] file\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] --half-life SECONDS [--time-field N] file\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] --follow [--interval SECONDS] file\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] [--snapshot-file FILE] file\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] --memory-limit SIZE file\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] --partitioned file...\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] --merge-sorted file...\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] --radix-sort [--threads N] [--sample RATE] file\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] --threads N file...\n"
+    "  stree [-f] [-F] --top K [--min-depth N] [--sample RATE] file\n"
+    "  stree [-a] [-s] [-p] [-f] [-F] [--checkpoint FILE [--checkpoint-interval SECONDS]]\n"
+    "        [--resume FILE] file\n"
+    "  stree [--stats] [--huge-pages MODE] [--numa POLICY] [--relayout] ...\n"
     "  stree -h\n"
     "\n"
     "DESCRIPTION\n"
@@ -68,6 +111,195 @@ void usage()
     "      can be uesful together with -s if you view the output with an editor\n"
     "      that is capable to fold by indent.\n"
     "\n"
+    "  --distinct-field N\n"
+    "      Count the distinct values of the N-th whitespace separated field (starting\n"
+    "      at 1) for every prefix, e.g. the number of client addresses that requested\n"
+    "      an URL prefix. The field is removed from the string that enters the trie\n"
+    "      and the estimate is written next to the frequency. Implies -f unless -F is\n"
+    "      given. Counts are exact for small sets and HyperLogLog estimates (about\n"
+    "      1.6% standard error) for larger ones.\n"
+    "\n"
+    "  --distinct-threshold N\n"
+    "      Number of distinct values a string keeps exactly before switching to a\n"
+    "      HyperLogLog sketch. Defaults to 64.\n"
+    "\n"
+    "  --memory-cap SIZE\n"
+    "      Keep at most SIZE bytes of trie nodes (suffixes K, M and G are understood),\n"
+    "      including what they keep for other options, such as the distinct values of\n"
+    "      --distinct-field. This allows to run on endless streams. Whenever the cap\n"
+    "      is exceeded, the least frequent strings are dropped and counted as ending\n"
+    "      at their parent. A prefix that shows up again after having been dropped\n"
+    "      may have been undercounted; such counts are written as N+E, meaning that\n"
+    "      the true count is between N and N+E. Frequent prefixes are kept with exact\n"
+    "      counts.\n"
+    "\n"
+    "  --count-min SIZE\n"
+    "      Do not build a trie of the input, but count the prefixes of the depths\n"
+    "      given by --count-min-depths in a Count-Min sketch, together with a fixed\n"
+    "      number of the most frequent prefixes of each depth. Memory stays at about\n"
+    "      SIZE bytes, no matter how large the input is. Three quarters of SIZE are\n"
+    "      used for the sketch, which has 4 rows of w = 3 * SIZE / 128 counters. A\n"
+    "      count is never too low and, with a probability of 98%, too high by at most\n"
+    "      2.72 * N / w. All depths share the sketch, so N is the number of prefixes\n"
+    "      counted: each string adds one for every listed depth it is long enough to\n"
+    "      reach. The bound reached is written to stderr. These counts are written as\n"
+    "      ~N. Only prefixes of these depths are reported, the root with the exact\n"
+    "      number of strings. Not available together with options that keep more\n"
+    "      than counts.\n"
+    "\n"
+    "  --count-min-depths LIST\n"
+    "      Comma separated list of the prefix lengths counted by --count-min.\n"
+    "      Defaults to 1,2,4,8,16,32,64.\n"
+    "\n"
+    "  --sample RATE\n"
+    "      Only use a random sample of the strings, each one being picked with a\n"
+    "      probability of RATE (0 < RATE <= 1). The strings in between are skipped\n"
+    "      without further processing, so the time needed shrinks with RATE. Counts\n"
+    "      are scaled up by 1/RATE and written as ~N.\n"
+    "\n"
+    "  --sample-ci\n"
+    "      With --sample, follow each count by the half width of its 95% confidence\n"
+    "      interval, e.g. ~1200+-68.\n"
+    "\n"
+    "  --seed N\n"
+    "      Start the random numbers of --sample with N, so that the same input gives\n"
+    "      the same sample again. Defaults to a seed taken from the clock.\n"
+    "\n"
+    "  --time-field N\n"
+    "      Take the time of each string, in seconds since the epoch, from its N-th\n"
+    "      whitespace separated field, which is then removed from the string. Strings\n"
+    "      without a valid time, a finite decimal number that is not absurdly far from\n"
+    "      0, are ignored. Without this option, the time a string is read is used.\n"
+    "\n"
+    "  --window SECONDS\n"
+    "      Only count the strings of the last SECONDS seconds, up to the latest time\n"
+    "      seen (with --time-field) or the current time. Old counts expire as new\n"
+    "      strings arrive, and prefixes without any strings left are removed, so the\n"
+    "      trie only holds the active window.\n"
+    "\n"
+    "  --window-buckets N\n"
+    "      The window advances in steps of SECONDS/N seconds. Defaults to 10.\n"
+    "\n"
+    "  --half-life SECONDS\n"
+    "      Also keep a score for each prefix, to which each string contributes 1 at\n"
+    "      its time, halving every SECONDS seconds. The score at the latest time\n"
+    "      seen (with --time-field) or the current time is written after the\n"
+    "      frequency, and -f and -F sort by it, which shows what is trending. Implies\n"
+    "      -f unless -F is given.\n"
+    "\n"
+    "  --follow\n"
+    "      Do not stop at the end of the files, but keep reading what is appended to\n"
+    "      them, like tail -f, and write the tree again every --interval seconds.\n"
+    "      Subtrees that did not change since the last time are not formatted again.\n"
+    "      A file that is moved away or deleted, as by log rotation, is read to its\n"
+    "      end and then followed again under its name once it is created anew. When\n"
+    "      reading from stdin, stree stops once stdin ends.\n"
+    "\n"
+    "  --interval SECONDS\n"
+    "      How often --follow writes the tree. Defaults to 10.\n"
+    "\n"
+    "  --snapshot-file FILE\n"
+    "      Where to write the tree when stree receives SIGUSR1, which allows to peek\n"
+    "      at long runs. The snapshot reflects all strings up to some point of the\n"
+    "      input and is written by a forked copy of stree, so reading goes on\n"
+    "      meanwhile. While stree waits for input, the snapshot is taken right\n"
+    "      away. Defaults to stree.snapshot. With --threads but without\n"
+    "      --radix-sort, SIGUSR1 is ignored and this option is not available.\n"
+    "\n"
+    "  --memory-limit SIZE\n"
+    "      Whenever the trie grows beyond SIZE bytes, write its strings in sorted\n"
+    "      order to a temporary file and start over with an empty trie. In the end,\n"
+    "      the files are merged to give the same output as usual, without ever\n"
+    "      holding more than SIZE bytes of trie. Not available together with options\n"
+    "      that keep more than counts.\n"
+    "\n"
+    "  --partitioned\n"
+    "      Read the files once to count the strings by their first character, and\n"
+    "      then once more for each first character, building and writing only the\n"
+    "      part of the trie below it. This needs as much memory as the largest part\n"
+    "      instead of the whole trie, and gives the same output. The files have to\n"
+    "      be regular files. Not available together with options that keep more\n"
+    "      than counts, or with --sample.\n"
+    "\n"
+    "  --merge-sorted\n"
+    "      The files are sorted already (as by LC_ALL=C sort), so merge them like\n"
+    "      sort -m and write the tree while doing so, without building a trie. Only\n"
+    "      the current string of each file is looked at, so memory does not depend\n"
+    "      on the size of the files. Not available together with options that keep\n"
+    "      more than counts, or with --sample.\n"
+    "\n"
+    "  --radix-sort\n"
+    "      Do not build a trie, but keep the strings in one buffer and sort them\n"
+    "      with a radix sort, which visits the same prefixes as the trie and writes\n"
+    "      the tree on the way. This needs much less memory than the trie and is\n"
+    "      usually faster for large inputs. Not available together with options\n"
+    "      that keep more than counts.\n"
+    "\n"
+    "  --top K\n"
+    "      Instead of the tree, write the K most frequent of its nodes, one per line\n"
+    "      with the whole string, most frequent first. Rather than going through\n"
+    "      the whole trie, the search follows the most frequent nodes and leaves\n"
+    "      out subtrees that count less than K nodes found already. Not available\n"
+    "      together with -a, -s, -p, -b or -g.\n"
+    "\n"
+    "  --min-depth N\n"
+    "      With --top, only nodes whose strings are at least N characters long.\n"
+    "      Defaults to 1.\n"
+    "\n"
+    "  --threads N\n"
+    "      Each file is split into N parts, which N threads enter into one shared\n"
+    "      trie at the same time, without locks. Input from stdin or pipes is read\n"
+    "      by one thread. With --radix-sort, sort with N threads instead: the\n"
+    "      strings are split into N ranges by a sample, which are sorted in\n"
+    "      parallel, and the common prefix of neighbouring strings is found in\n"
+    "      parallel as well. Only writing the tree is left to one thread. Not\n"
+    "      available together with options that keep more than counts, or with\n"
+    "      --sample. N can be at most four times the number of processors.\n"
+    "      Defaults to 1.\n"
+    "\n"
+    "  --checkpoint FILE\n"
+    "      Save the trie and how far each input file has been read to FILE every\n"
+    "      --checkpoint-interval seconds, and once more when all input has been\n"
+    "      read. Like snapshots, checkpoints are written by a forked copy of stree\n"
+    "      while reading goes on. The input has to be regular files, not stdin or\n"
+    "      pipes. Not available together with options that keep more than counts\n"
+    "      (--count-min, --distinct-field, --half-life, --memory-cap and --window).\n"
+    "\n"
+    "  --checkpoint-interval SECONDS\n"
+    "      Defaults to 300.\n"
+    "\n"
+    "  --resume FILE\n"
+    "      Start with the trie of checkpoint FILE and continue each input file where\n"
+    "      the checkpoint left off. The same input files have to be given again,\n"
+    "      under any name, and have to be regular files. Whatever has been appended\n"
+    "      to them since the checkpoint is added to its counts.\n"
+    "\n"
+    "  --stats\n"
+    "      Write the time needed for reading and writing, the memory taken from the\n"
+    "      system for trie nodes and the peak memory use to stderr at the end.\n"
+    "\n"
+    "  --huge-pages MODE\n"
+    "      Put trie nodes on huge pages, which saves the processor from looking up\n"
+    "      addresses on every step through a large trie. With MODE transparent, the\n"
+    "      kernel is asked to back the node memory with transparent huge pages. With\n"
+    "      MODE explicit, pages are taken from the huge pages reserved in\n"
+    "      /proc/sys/vm/nr_hugepages, falling back to transparent ones when there\n"
+    "      are not enough.\n"
+    "\n"
+    "  --numa POLICY\n"
+    "      Where node memory goes on machines with several NUMA nodes. With POLICY\n"
+    "      local, memory is taken from the NUMA node of the thread that uses it\n"
+    "      first, and each thread of --threads has its own memory for the nodes it\n"
+    "      creates. With POLICY interleave, pages are spread over all NUMA nodes.\n"
+    "      --stats shows where the memory ended up.\n"
+    "\n"
+    "  --relayout\n"
+    "      Copy the trie before writing it, so that its nodes are in memory in the\n"
+    "      order they are written in. Writing is faster then, though not by as\n"
+    "      much as copying takes, and the old trie is kept until stree ends, which\n"
+    "      doubles the memory for nodes. Only the plain trie is copied, other ways\n"
+    "      of building the tree are not affected.\n"
+    "\n"
     "  -h  Print this help and exit\n"
     "\n"
     "AUTHOR\n"
@@ -76,247 +308,4094 @@ void usage()
 }
 
 /*
-  For each bhaviour, there is a static bool signifying to what it has been set.
+  For each bhaviour, there is a static variable signifying to what it has been set.
   Each option also has a function to set the corresponding behaviour.
 
   All these functions are stored in a map for later execution.
 */
 static std::map< std::string, void(*)() > optionSetter;
 
-static bool forceAlphabetically = false;
-void setForceAlphabetically() { forceAlphabetically = true; }
-
-static bool repeatPrefix = true;
-void setNoRepeatPrefix() { repeatPrefix = false; }
-
-static bool appendFrequency = false;
-void setAppendFrequency() { appendFrequency = true; }
+// How the tree is written is up to libstree
+static formatOptions_t format;
+void setForceAlphabetically() { format.forceAlphabetically = true; }
+void setNoRepeatPrefix() { format.repeatPrefix = false; }
+void setAppendFrequency() { format.appendFrequency = true; }
+void setPrependFrequency() { format.prependFrequency = true; }
+void setParentheses() { format.structureStyle = parentheses; }
+void setBash() { format.structureStyle = bash; }
+void setGraphviz() { format.structureStyle = graphviz; }
 
-static bool prependFrequency = false;
-void setPrependFrequency() { prependFrequency = true; }
+/*
+  Options that take an argument work the same way, but their setter is given the argument.
+*/
+static std::map< std::string, void(*)( const char * ) > optionArgSetter;
 
-enum structureStyle_t
+/*
+  Parse a whole number of digits only into n. strtoull() alone would skip spaces and accept signs,
+  turning e.g. -1 into the largest number.
+*/
+bool parseCount( const char *arg, unsigned long long &n )
 {
-  linewise,
-  parentheses,
-  bash,
-  graphviz
-};
-static structureStyle_t structureStyle = linewise;
-void setParentheses() { structureStyle = parentheses; }
-void setBash() { structureStyle = bash; }
-void setGraphviz() { structureStyle = graphviz; }
+  if ( !isdigit( static_cast< unsigned char >( *arg ) ) )
+    return false;
+  char *end;
+  errno = 0;
+  n = strtoull( arg, &end, 10 );
+  return !*end && errno != ERANGE;
+}
 
 /*
-  A charNode_c represents a node in the trie of strings.
+  Parse a size in bytes, digits only as with parseCount(), optionally followed by K, M or G. Returns
+  0 if it can not be parsed or does not fit.
+*/
+unsigned long long parseSize( const char *arg )
+{
+  if ( !isdigit( static_cast< unsigned char >( *arg ) ) )
+    return 0;
+  char *end;
+  errno = 0;
+  unsigned long long size = strtoull( arg, &end, 10 );
+  if ( errno == ERANGE )
+    return 0;
+  int shift = 0;
+  switch ( *end )
+  {
+    case 'G': case 'g': shift += 10; [[fallthrough]];
+    case 'M': case 'm': shift += 10; [[fallthrough]];
+    case 'K': case 'k': shift += 10; ++end;
+  }
+  if ( *end || size > std::numeric_limits< unsigned long long >::max() >> shift )
+    return 0;
+  return size << shift;
+}
 
-  It represents some prefix of all strings stored below it, has a count for the number of them and a
-  map of charNode_c's that can follow.
+/*
+  Parse a finite number, as strtod() does, into x. All of arg has to be the number, and unlike
+  atof() nothing is taken to be 0.
 */
-class charNode_c;
-typedef std::map< char, charNode_c > charNodes_c;
-class charNode_c
+bool parseNumber( const char *arg, double &x )
 {
-  unsigned int _count;
-  charNodes_c _next;
+  if ( !*arg || isspace( static_cast< unsigned char >( *arg ) ) )
+    return false;
+  char *end;
+  errno = 0;
+  x = strtod( arg, &end );
+  return !*end && errno != ERANGE && std::isfinite( x );
+}
 
-public:
-  charNode_c() : _count( 0 ) {}
-  charNodes_c& next()             { return _next; }
-  const charNodes_c& next() const { return _next; }
-  bool operator++()               { ++_count; }
-  unsigned int count() const      { return _count; }
+static int distinctField = 0;
+void setDistinctField( const char *arg )
+{
+  unsigned long long n;
+  if ( !parseCount( arg, n ) || n < 1 || n > static_cast< unsigned int >( std::numeric_limits< int >::max() ) )
+    usage();
+  distinctField = n;
+}
+
+static unsigned int distinctThreshold = 64;
+void setDistinctThreshold( const char *arg )
+{
+  unsigned long long n;
+  if ( !parseCount( arg, n ) || n < 1 || n > std::numeric_limits< unsigned int >::max() )
+    usage();
+  distinctThreshold = n;
+}
+
+static unsigned long long memoryCap = 0;
+void setMemoryCap( const char *arg )
+{
+  memoryCap = parseSize( arg );
+  if ( !memoryCap )
+    usage();
+}
+
+static unsigned long long memoryLimit = 0;
+void setMemoryLimit( const char *arg )
+{
+  memoryLimit = parseSize( arg );
+  if ( !memoryLimit )
+    usage();
+}
+
+static bool printStats = false;
+void setStats() { printStats = true; }
+
+static bool relayoutTrie = false;
+void setRelayout() { relayoutTrie = true; }
+
+enum hugePages_t
+{
+  noHugePages,
+  transparentHugePages,
+  explicitHugePages
+};
+static hugePages_t hugePages = noHugePages;
+void setHugePages( const char *arg )
+{
+  if ( strcmp( arg, "transparent" ) == 0 )
+    hugePages = transparentHugePages;
+  else if ( strcmp( arg, "explicit" ) == 0 )
+    hugePages = explicitHugePages;
+  else
+    usage();
+}
+
+enum numaPolicy_t
+{
+  defaultPlacement,
+  localPlacement,
+  interleavedPlacement
 };
+static numaPolicy_t numaPolicy = defaultPlacement;
+void setNuma( const char *arg )
+{
+  if ( strcmp( arg, "local" ) == 0 )
+    numaPolicy = localPlacement;
+  else if ( strcmp( arg, "interleave" ) == 0 )
+    numaPolicy = interleavedPlacement;
+  else
+    usage();
+}
+
+static bool partitioned = false;
+void setPartitioned() { partitioned = true; }
+
+static bool mergeSorted = false;
+void setMergeSorted() { mergeSorted = true; }
 
-bool orderByCount( const charNodes_c::const_iterator &lhs, const charNodes_c::const_iterator &rhs )
+static bool radixSort = false;
+void setRadixSort() { radixSort = true; }
+
+static unsigned long long topCount = 0;
+void setTop( const char *arg )
 {
-  return lhs->second.count() > rhs->second.count();
+  if ( !parseCount( arg, topCount ) || topCount < 1 )
+    usage();
 }
 
-void read( std::istream &in, charNode_c &root )
+static unsigned long long minDepth = 1;
+static bool minDepthSet = false;
+void setMinDepth( const char *arg )
 {
-  std::string s;
-  while ( getline( in, s ) )
+  if ( !parseCount( arg, minDepth ) )
+    usage();
+  minDepthSet = true;
+}
+
+/*
+  More than a few threads per processor only add overhead, and --radix-sort keeps a table of
+  threads * threads bucket counts, so the number is bounded.
+*/
+static unsigned int threads = 1;
+void setThreads( const char *arg )
+{
+  unsigned long long n;
+  const unsigned long long limit = std::max( 1u, std::thread::hardware_concurrency() ) * 4ULL;
+  if ( !parseCount( arg, n ) || n < 1 || n > limit )
+    usage();
+  threads = n;
+}
+
+static unsigned long long countMinSize = 0;
+void setCountMin( const char *arg )
+{
+  countMinSize = parseSize( arg );
+  if ( countMinSize < 1024 )
+    usage();
+}
+
+static std::vector< std::size_t > countMinDepths;
+void setCountMinDepths( const char *arg )
+{
+  // Each depth is a whole number from 1 on, there are no empty ones
+  countMinDepths.clear();
+  const std::string list( arg );
+  for ( std::size_t begin = 0; ; )
   {
-    ++root;
-    charNode_c *current = &root;
-    for ( int i = 0; i < s.length(); ++i )
-    {
-      // Enter the string while counting the charcters
-      current = &current->next()[ s[ i ] ];
-      ++*current;
-    }
+    const std::size_t end = std::min( list.find( ',', begin ), list.length() );
+    unsigned long long depth;
+    if ( !parseCount( list.substr( begin, end - begin ).c_str(), depth ) || depth < 1 ||
+         depth > static_cast< unsigned int >( std::numeric_limits< int >::max() ) )
+      usage();
+    countMinDepths.push_back( depth );
+    if ( end == list.length() )
+      break;
+    begin = end + 1;
   }
+  std::sort( countMinDepths.begin(), countMinDepths.end() );
+  countMinDepths.erase( std::unique( countMinDepths.begin(), countMinDepths.end() ),
+                        countMinDepths.end() );
 }
 
-/*
-  Print the prefix tree to stdout.
+// Set by engines whose counts are estimates, which are then written as ~N
+static bool estimatedCounts = false;
+
+static double sampleRate = 1;
+void setSample( const char *arg )
+{
+  if ( !parseNumber( arg, sampleRate ) || !( sampleRate > 0 && sampleRate <= 1 ) )
+    usage();
+}
 
-  Given a charNode_c *node, the character it represents 'c' and the prefix that is common to all
-  strings represented by node, the subnodes of node are written to stdout.
+static bool sampleConfidence = false;
+void setSampleConfidence() { sampleConfidence = true; }
 
-  if 'c' is NUL, node is assumed to be the root of the prefix tree.
-*/
-void dump( std::ostream &out, std::string current, std::string prefix,
-           const charNode_c *node, bool isRootNode )
+static unsigned long long sampleSeed = 0;
+static bool sampleSeedSet = false;
+void setSeed( const char *arg )
+{
+  if ( !parseCount( arg, sampleSeed ) )
+    usage();
+  sampleSeedSet = true;
+}
+
+static int timeField = 0;
+void setTimeField( const char *arg )
+{
+  unsigned long long n;
+  if ( !parseCount( arg, n ) || n < 1 || n > static_cast< unsigned int >( std::numeric_limits< int >::max() ) )
+    usage();
+  timeField = n;
+}
+
+static double windowSeconds = 0;
+void setWindow( const char *arg )
+{
+  if ( !parseNumber( arg, windowSeconds ) || !( windowSeconds > 0 ) )
+    usage();
+}
+
+static int windowBuckets = 10;
+void setWindowBuckets( const char *arg )
+{
+  unsigned long long n;
+  if ( !parseCount( arg, n ) || n < 1 || n > static_cast< unsigned int >( std::numeric_limits< int >::max() ) )
+    usage();
+  windowBuckets = n;
+}
+
+// The window ends with this bucket, see windowBucket()
+static long long newestBucket = std::numeric_limits< long long >::min();
+
+static double halfLife = 0;
+void setHalfLife( const char *arg )
+{
+  if ( !parseNumber( arg, halfLife ) || !( halfLife > 0 ) )
+    usage();
+}
+
+// Latest time seen, decayed scores are reported as of then
+static double newestTime = 0;
+
+static bool followInputs = false;
+void setFollow() { followInputs = true; }
+
+static double followInterval = 10;
+void setInterval( const char *arg )
 {
-  // Nodes need to exist
-  if ( !node || !node->count() ) return;
+  if ( !parseNumber( arg, followInterval ) || !( followInterval > 0 ) )
+    usage();
+}
+
+static std::string snapshotFile = "stree.snapshot";
+static bool snapshotFileSet = false;
+void setSnapshotFile( const char *arg )
+{
+  snapshotFile = arg;
+  snapshotFileSet = true;
+}
 
-  // If there is just one possible an non-optional continuation of the string, we do not want to put
-  // it on an extra line, but add it to the current one.
-  //
-  // We can only do this if...
-  if ( node->next().size() == 1 &&             // ...there is only one way to contiune and...
-       node->next().begin()->second.count() == // ...the current string can not end here.
-       node->count() )
+// The signal handlers write to this pipe, so that a reader waiting for input wakes up for them
+static int wakeUp[ 2 ] = { -1, -1 };
+void wakeReader()
+{
+  const int saved = errno;
+  if ( wakeUp[ 1 ] >= 0 && write( wakeUp[ 1 ], "", 1 ) < 0 )
   {
-    // We implement this by recursion
-    dump( out, current + node->next().begin()->first, prefix,
-          &node->next().begin()->second, isRootNode );
-    return;
+    // The pipe is full, so the reader is going to wake up anyway
   }
+  errno = saved;
+}
+
+// Set by the SIGUSR1 handler, the readers take the snapshot before the next string
+static volatile sig_atomic_t snapshotRequested = 0;
+void requestSnapshot( int )
+{
+  snapshotRequested = 1;
+  wakeReader();
+}
+
+static std::string checkpointFile;
+void setCheckpoint( const char *arg ) { checkpointFile = arg; }
+
+static double checkpointInterval = 300;
+void setCheckpointInterval( const char *arg )
+{
+  if ( !parseNumber( arg, checkpointInterval ) || !( checkpointInterval > 0 ) )
+    usage();
+}
+
+static std::string resumeFile;
+void setResume( const char *arg ) { resumeFile = arg; }
+
+// Set by the SIGALRM handler every checkpointInterval seconds
+static volatile sig_atomic_t checkpointRequested = 0;
+void requestCheckpoint( int )
+{
+  checkpointRequested = 1;
+  wakeReader();
+}
 
-  // The root node in graphviz needs special consideration
-  if ( isRootNode && structureStyle == graphviz )
-     out << "digraph {";
+/*
+  Wait up to timeout milliseconds, or forever if it is negative, until fd can be read or a signal
+  has asked for something. Returns whether fd can be read.
+*/
+bool waitForInput( int fd, int timeout = -1 )
+{
+  struct pollfd ready[ 2 ];
+  ready[ 0 ].fd = fd;
+  ready[ 1 ].fd = wakeUp[ 0 ];
+  ready[ 0 ].events = ready[ 1 ].events = POLLIN;
+  ready[ 0 ].revents = ready[ 1 ].revents = 0;
+  if ( poll( ready, 2, timeout ) <= 0 )
+    return false;
+  char drained[ 64 ];
+  if ( ready[ 1 ].revents )
+    while ( read( wakeUp[ 0 ], drained, sizeof drained ) > 0 )
+      ;
+  return ready[ 0 ].revents != 0;
+}
 
-  // Invariants at this point:
-  // - The way root -> node represents the string prefix+current of which the prefix part has
-  //   already been printed, but the current part has not.
-  // - prefix+current is a complete string from the input data set, or it is the longest
-  //   common prefix of at least two such strings.
+/*
+  How far each input file has been read, which is what a checkpoint needs besides the trie. The
+  offsets always point to the start of a line.
+*/
+struct inputPosition_t
+{
+  std::string path;
+  unsigned long long offset;
+};
+static std::vector< inputPosition_t > inputPositions;
 
-  // Some output formats require that we surround the current string with something:
-  if ( structureStyle == parentheses )
-    out << "(";
+/*
+  When the trie is pruned to stay within memoryCap, every pruning round drops nodes that have been
+  counted at most pruneThresholds.back() times. A node that is created after round r may thus have
+  missed up to pruneThresholds[ r ] counts, which is its error.
+*/
+static std::vector< unsigned long long > pruneThresholds( 1, 0 );
 
-  // print current string, possible repeating the prefix along the way, and decorate the thing with
-  // frequencies.
-  if ( prependFrequency )
+/*
+  Remove the whitespace separated field number 'field' (counting from 1) from 'line' and store it in
+  'value'. The remaining fields are joined by single spaces. Returns false, leaving 'line' as it is,
+  if there are not enough fields.
+*/
+bool cutField( std::string &line, int field, std::string &value )
+{
+  std::string rest;
+  bool found = false;
+  int n = 0;
+  std::string::size_type end = 0;
+  while ( true )
   {
-    if ( structureStyle == linewise )
-      out << std::setw( 8 ) << std::left; // neat vertical alignment
-    out << node->count();
-    if ( !current.empty() )
-       out << " ";
+    std::string::size_type begin = line.find_first_not_of( " \t", end );
+    if ( begin == std::string::npos )
+      break;
+    end = line.find_first_of( " \t", begin );
+    if ( end == std::string::npos )
+      end = line.length();
+    if ( ++n == field )
+    {
+      value.assign( line, begin, end - begin );
+      found = true;
+    }
+    else
+    {
+      if ( !rest.empty() )
+        rest += ' ';
+      rest.append( line, begin, end - begin );
+    }
   }
+  if ( found )
+    line.swap( rest );
+  return found;
+}
 
-  if ( repeatPrefix )
-    out << prefix << current;
-  else if ( structureStyle == linewise )
-    // Use whitespace instead
-    out << std::string( prefix.length(), ' ' ) << current;
-  else
-    out << current;
+/*
+  64 bit hash of a byte string: FNV-1a, followed by the splitmix64 finalizer so that all bits are
+  usable by the sketches. fnvStep() and mix64() allow to hash all prefixes of a string in one go.
+*/
+const unsigned long long fnvBasis = 14695981039346656037ULL;
+inline unsigned long long fnvStep( unsigned long long h, char c )
+{
+  return ( h ^ static_cast< unsigned char >( c ) ) * 1099511628211ULL;
+}
+
+inline unsigned long long mix64( unsigned long long h )
+{
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+unsigned long long hash64( const char *s, std::size_t length )
+{
+  unsigned long long h = fnvBasis;
+  for ( std::size_t i = 0; i < length; ++i )
+    h = fnvStep( h, s[ i ] );
+  return mix64( h );
+}
+
+/*
+  A distinctSketch_c estimates the number of distinct values added to it.
+
+  Up to distinctThreshold values, their hashes are kept in a sorted vector. This is exact (apart
+  from hash collisions) and keeps the many rarely seen strings small. Beyond that, the sketch turns
+  into a HyperLogLog with 2^distinctPrecision one byte registers, i.e. 4 KiB per sketch no matter
+  how many values are added.
+*/
+const int distinctPrecision = 12;
+class distinctSketch_c
+{
+  std::vector< unsigned long long > _sparse;
+  std::vector< unsigned char > _registers;
 
-  if ( appendFrequency )
+  void addToRegisters( unsigned long long hash )
   {
-    if ( !current.empty() || prependFrequency )
-      out << " ";
-    out << node->count();
+    const unsigned long long index = hash >> ( 64 - distinctPrecision );
+    // Guard bit so that the rank is bounded even if all remaining bits are zero
+    const unsigned long long rest = ( hash << distinctPrecision ) | ( 1ULL << ( distinctPrecision - 1 ) );
+    const unsigned char rank = __builtin_clzll( rest ) + 1;
+    if ( _registers[ index ] < rank )
+      _registers[ index ] = rank;
   }
 
-  if ( structureStyle == linewise )
-    out << "\n";
+  void densify()
+  {
+    _registers.assign( 1 << distinctPrecision, 0 );
+    for ( std::size_t i = 0; i < _sparse.size(); ++i )
+      addToRegisters( _sparse[ i ] );
+    std::vector< unsigned long long >().swap( _sparse );
+  }
 
-  // We may need to recurse.
-  if ( !node->next().empty() )
+public:
+  void add( unsigned long long hash )
   {
-    if ( structureStyle == graphviz && !current.empty() )
-      out << " -> {";
-    if ( structureStyle == bash )
+    if ( !_registers.empty() )
     {
-      // bash output compresses "foo foolish" to "foo{,lish}". To determine if node represents a
-      // string in its own right, we check if is more often in the input data set than the sum of
-      // the children.
-      std::size_t nextCount = 0;
-      for ( charNodes_c::const_iterator it = node->next().begin();
-            it != node->next().end();
-            ++it )
-        nextCount += it->second.count();
-      if ( nextCount < node->count() )
-        out << "{,";
-      else
-        out << "{";
+      addToRegisters( hash );
+      return;
     }
+    std::vector< unsigned long long >::iterator it =
+      std::lower_bound( _sparse.begin(), _sparse.end(), hash );
+    if ( it != _sparse.end() && *it == hash )
+      return;
+    _sparse.insert( it, hash );
+    if ( _sparse.size() > distinctThreshold )
+      densify();
+  }
 
-    // Now dump each child, sorted by frequency if is visible unless the user says no
-    std::vector< charNodes_c::const_iterator > children;
-    for ( charNodes_c::const_iterator it = node->next().begin();
-          it != node->next().end();
-          ++it )
-      children.push_back( it );
-    if ( ( prependFrequency || appendFrequency ) && !forceAlphabetically )
-      sort( children.begin(), children.end(), orderByCount );
-    std::vector< charNodes_c::const_iterator >::const_iterator cit;
-    for ( cit = children.begin(); cit != children.end(); ++cit )
+  void merge( const distinctSketch_c &other )
+  {
+    if ( other._registers.empty() )
     {
-      if ( cit != children.begin() )
-        if ( structureStyle == graphviz )
-          out << ";";
-        else if ( structureStyle == bash )
-          out << ",";
-
-      dump( out, std::string( 1, ( *cit )->first ), prefix + current,
-            &( *cit )->second, false );
+      for ( std::size_t i = 0; i < other._sparse.size(); ++i )
+        add( other._sparse[ i ] );
+      return;
     }
-    if ( structureStyle == graphviz && !current.empty() ||
-         structureStyle == bash )
-      out << "}";
+    if ( _registers.empty() )
+      densify();
+    for ( std::size_t i = 0; i < _registers.size(); ++i )
+      if ( _registers[ i ] < other._registers[ i ] )
+        _registers[ i ] = other._registers[ i ];
+  }
+
+  // Bytes taken from the heap
+  std::size_t footprint() const
+  {
+    return _sparse.capacity() * sizeof( unsigned long long ) + _registers.capacity();
   }
 
-  if ( structureStyle == parentheses )
-    out << ")";
-  if ( isRootNode )
+  unsigned long long estimate() const
   {
-    if ( structureStyle == graphviz || ( structureStyle == bash && !isRootNode ) )
-      out << "}";
-    out << "\n";
+    if ( _registers.empty() )
+      return _sparse.size();
+
+    const double m = _registers.size();
+    double sum = 0;
+    int zeros = 0;
+    for ( std::size_t i = 0; i < _registers.size(); ++i )
+    {
+      sum += std::ldexp( 1.0, -_registers[ i ] );
+      if ( !_registers[ i ] )
+        ++zeros;
+    }
+    double estimate = 0.7213 / ( 1 + 1.079 / m ) * m * m / sum;
+    // Small range correction: linear counting is more precise while there are empty registers
+    if ( estimate <= 2.5 * m && zeros )
+      estimate = m * std::log( m / zeros );
+    return static_cast< unsigned long long >( estimate + 0.5 );
   }
+};
+
+/*
+  Number of the bucket of width windowSeconds / windowBuckets a time falls into.
+*/
+long long windowBucket( double time )
+{
+  return static_cast< long long >( std::floor( time * windowBuckets / windowSeconds ) );
 }
 
-int main( int argc, char *argv[] )
+// Times and their buckets stay this far from 0, so that their differences can be taken
+const double timeLimit = 0x1p62;
+
+/*
+  Parse the time field of a string, a finite decimal number, as parseNumber() does. Times too far
+  out for windowBucket() or for the distance to other times are not valid either.
+*/
+bool parseTime( const std::string &field, double &time )
 {
-  optionSetter[ "-h" ] = usage;
-  optionSetter[ "-a" ] = setForceAlphabetically;
-  optionSetter[ "-s" ] = setNoRepeatPrefix;
-  optionSetter[ "-f" ] = setPrependFrequency;
-  optionSetter[ "-F" ] = setAppendFrequency;
-  optionSetter[ "-p" ] = setParentheses;
-  optionSetter[ "-b" ] = setBash;
-  optionSetter[ "-g" ] = setGraphviz;
+  if ( field.find_first_of( "xX" ) != std::string::npos || !parseNumber( field.c_str(), time ) ||
+       !( std::fabs( time ) < timeLimit ) )
+    return false;
+  return !windowSeconds || std::fabs( std::floor( time * windowBuckets / windowSeconds ) ) < timeLimit;
+}
 
-  int i;
-  for ( i = 1; i < argc; ++i )
+/*
+  A windowCounts_c keeps the counts of a node for the last windowBuckets buckets in a ring. Buckets
+  that have left the window are only cleared when the node is accessed again.
+*/
+class windowCounts_c
+{
+  std::vector< unsigned long long > _ring;
+  long long _bucket; // latest bucket of the ring
+
+  // Times before the epoch have negative buckets
+  static std::size_t slot( long long bucket )
   {
-    if ( strcmp( argv[ i ], "--" ) == 0 )
+    return ( bucket % windowBuckets + windowBuckets ) % windowBuckets;
+  }
+
+public:
+  windowCounts_c() : _bucket( 0 ) {}
+
+  /*
+    Move the ring forward to end with 'bucket', returns the sum of the counts that expired.
+  */
+  unsigned long long advance( long long bucket )
+  {
+    if ( _ring.empty() )
     {
-      // End of options
-      ++i;
-      break;
+      _ring.assign( windowBuckets, 0 );
+      _bucket = bucket;
     }
-    if ( optionSetter.count( argv[ i ] ) )
-      optionSetter[ argv[ i ] ]();
-    else
-      break;
+    unsigned long long expired = 0;
+    for ( long long b = _bucket + 1; b <= bucket && b <= _bucket + windowBuckets; ++b )
+    {
+      expired += _ring[ slot( b ) ];
+      _ring[ slot( b ) ] = 0;
+    }
+    _bucket = std::max( _bucket, bucket );
+    return expired;
   }
 
-  charNode_c root;
-  if ( i == argc )
+  // 'bucket' must still be in the window, i.e. later than _bucket - windowBuckets
+  void add( long long bucket ) { ++_ring[ slot( bucket ) ]; }
+};
+
+/*
+  A decayedCount_c is a count where every increment loses half of its weight each halfLife seconds.
+  It is stored as its value at the time of the last increment, so nodes that are not touched cost
+  nothing to keep up to date.
+*/
+class decayedCount_c
+{
+  double _value;
+  double _time;
+
+public:
+  decayedCount_c() : _value( 0 ), _time( 0 ) {}
+
+  double at( double time ) const { return _value * std::exp2( ( _time - time ) / halfLife ); }
+
+  void add( double time )
   {
-    // read from stdin
-    read( std::cin, root );
+    if ( time >= _time )
+    {
+      _value = at( time ) + 1;
+      _time = time;
+    }
+    else
+      // Out of order, contributes less than it would have in time
+      _value += std::exp2( ( time - _time ) / halfLife );
   }
-  else
+};
+
+/*
+  What a node keeps with --distinct-field.
+*/
+class distinctData_c
+{
+public:
+  distinctData_c() : count( 0 ) {}
+
+  distinctSketch_c values;  // values of the strings ending exactly at this node
+  unsigned long long count; // distinct values of all strings below, see collectDistinct()
+};
+
+/*
+  What a node keeps with --follow, so that a report can copy its output from the previous report
+  unless something below it has changed. Rather than the output itself, the node knows where it is
+  in the previous report, relative to the output of the node it was written within. Output copied
+  as a whole keeps the offsets below it valid.
+*/
+class renderState_c
+{
+public:
+  renderState_c() : dirty( true ), text( 0 ), within( 0 ), offset( 0 ), length( 0 ) {}
+
+  bool dirty;                 // something below has changed since the node was formatted
+  unsigned long long text;    // when the node was formatted last
+  unsigned long long within;  // the formatting of the node whose output it was last written within
+  std::size_t offset;
+  std::size_t length;
+};
+
+/*
+  A counter_c is a counter that never overflows but costs only 32 bits in the common case.
+
+  Once the inline value would wrap, it is set to 'promoted' and the actual value moves to a 64 bit
+  side table, keyed by the address of the counter. Nodes never move once they have been created, so
+  the address is stable. Only a handful of counters (the root and the hottest prefixes) ever get
+  promoted, everybody else pays a single, well predicted comparison per increment.
+
+  The side table is shared by all tries, which may live in different threads, so it is only used
+  under its lock.
+*/
+class counter_c
+{
+  static const unsigned int promoted = 0xffffffffU;
+  static std::map< const counter_c*, unsigned long long > _wide;
+  static std::mutex _wideLock;
+  unsigned int _value;
+
+  counter_c( const counter_c & );
+  counter_c& operator=( const counter_c & );
+
+  void addWide( unsigned long long n )
   {
-    for( ; i < argc; ++i )
+    std::lock_guard< std::mutex > lock( _wideLock );
+    if ( _value == promoted )
+      _wide[ this ] += n;
+    else
     {
-      std::fstream file( argv[ i ] );
-      read( file, root );
-      file.close();
+      _wide[ this ] = _value + n;
+      _value = promoted;
     }
   }
 
-  dump( std::cout, "", "", &root, true );
+  void dropWide()
+  {
+    std::lock_guard< std::mutex > lock( _wideLock );
+    _wide.erase( this );
+  }
+
+public:
+  counter_c() : _value( 0 ) {}
+  ~counter_c()
+  {
+    if ( _value == promoted )
+      dropWide();
+  }
+
+  void add( unsigned long long n )
+  {
+    if ( __builtin_expect( n < promoted - _value, 1 ) )
+      _value += n;
+    else
+      addWide( n );
+  }
+
+  void set( unsigned long long n )
+  {
+    if ( _value == promoted )
+      dropWide();
+    _value = 0;
+    add( n );
+  }
+
+  unsigned long long value() const
+  {
+    if ( __builtin_expect( _value != promoted, 1 ) )
+      return _value;
+    std::lock_guard< std::mutex > lock( _wideLock );
+    return _wide.find( this )->second;
+  }
+
+  // What basicTrie_c needs from its counters
+  counter_c &operator+=( unsigned long long n )
+  {
+    add( n );
+    return *this;
+  }
+  operator unsigned long long() const { return value(); }
+};
+std::map< const counter_c*, unsigned long long > counter_c::_wide;
+std::mutex counter_c::_wideLock;
+
+/*
+  The NUMA nodes that are online, as a mask for mbind(). Without NUMA, that is node 0.
+*/
+std::vector< unsigned long > onlineNumaNodes()
+{
+  const std::size_t bits = 8 * sizeof( unsigned long );
+  std::vector< unsigned long > mask( 1, 0 );
+  std::ifstream online( "/sys/devices/system/node/online" );
+  unsigned int first, last;
+  char separator = ',';
+  while ( separator == ',' && online >> first )
+  {
+    last = first;
+    if ( online.peek() == '-' )
+      online >> separator >> last;
+    for ( unsigned int node = first; node <= last; ++node )
+    {
+      if ( mask.size() <= node / bits )
+        mask.resize( node / bits + 1, 0 );
+      mask[ node / bits ] |= 1UL << ( node % bits );
+    }
+    if ( !online.get( separator ) )
+      break;
+  }
+  if ( !mask[ 0 ] && mask.size() == 1 )
+    mask[ 0 ] = 1;
+  return mask;
+}
+
+/*
+  Memory for nodes comes in chunks of 2 MiB, the size of a huge page, straight from mmap(). A
+  monotonic_buffer_resource on top of it hands out nodes with hardly any bookkeeping and does not
+  free them one by one, which suits the tries that only ever grow.
+
+  Chunks start at a multiple of their size, so that the kernel can back them with transparent huge
+  pages, and get their NUMA policy before they are first touched. Larger requests, from the buffers
+  of a growing arena, are only mapped to the next page unless they must be huge pages. Threads may
+  allocate at the same time. The chunks are remembered for --stats.
+*/
+class chunkResource_c : public std::pmr::memory_resource
+{
+  // mbind() and get_mempolicy() of <numaif.h>, which is not needed for just these
+  static const int mpolInterleave = 3, mpolLocal = 4;
+  static const int mpolFlagNode = 1, mpolFlagAddress = 2;
+
+  std::atomic< unsigned long long > _mapped;
+  std::atomic< unsigned int > _notHuge, _notPlaced;
+  std::mutex _mutex;
+  std::vector< std::pair< char*, std::size_t > > _chunks;
+
+  static std::size_t roundUp( std::size_t bytes, std::size_t to ) { return ( bytes + to - 1 ) / to * to; }
+
+  char *map( std::size_t size )
+  {
+    if ( hugePages == explicitHugePages )
+    {
+      void *chunk = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+      if ( chunk != MAP_FAILED )
+        return static_cast< char* >( chunk );
+      ++_notHuge;
+    }
+
+    // Map one chunk more, then cut the ends off so that the chunk is aligned
+    void *mapped = mmap( 0, size + chunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if ( mapped == MAP_FAILED )
+      throw std::bad_alloc();
+    char *begin = static_cast< char* >( mapped );
+    char *chunk = begin + ( chunkSize - reinterpret_cast< std::size_t >( begin ) % chunkSize ) % chunkSize;
+    if ( chunk > begin )
+      munmap( begin, chunk - begin );
+    if ( begin + chunkSize > chunk )
+      munmap( chunk + size, begin + chunkSize - chunk );
+    if ( hugePages != noHugePages && madvise( chunk, size, MADV_HUGEPAGE ) != 0 )
+      ++_notHuge;
+    return chunk;
+  }
+
+  void place( char *chunk, std::size_t size )
+  {
+    static const std::vector< unsigned long > nodes = onlineNumaNodes();
+    long result = 0;
+    if ( numaPolicy == localPlacement )
+      result = syscall( SYS_mbind, chunk, size, mpolLocal, 0, 0, 0 );
+    else if ( numaPolicy == interleavedPlacement )
+      result = syscall( SYS_mbind, chunk, size, mpolInterleave, &nodes[ 0 ],
+                        nodes.size() * 8 * sizeof( unsigned long ) + 1, 0 );
+    if ( result != 0 )
+      ++_notPlaced;
+  }
+
+  // Chunks come from mmap(), so they are aligned to pages of at least 4 KiB
+  void *do_allocate( std::size_t bytes, [[maybe_unused]] std::size_t alignment )
+  {
+    assert( alignment <= pageSize );
+    const std::size_t size = roundUp( bytes, hugePages == explicitHugePages ? chunkSize : pageSize );
+    char *chunk = map( size );
+    place( chunk, size );
+    _mapped += size;
+    std::lock_guard< std::mutex > lock( _mutex );
+    _chunks.push_back( std::make_pair( chunk, size ) );
+    return chunk;
+  }
+
+  void do_deallocate( void *chunk, std::size_t, std::size_t )
+  {
+    std::lock_guard< std::mutex > lock( _mutex );
+    for ( std::size_t i = 0; i < _chunks.size(); ++i )
+      if ( _chunks[ i ].first == chunk )
+      {
+        munmap( chunk, _chunks[ i ].second );
+        _mapped -= _chunks[ i ].second;
+        _chunks.erase( _chunks.begin() + i );
+        break;
+      }
+  }
+
+  bool do_is_equal( const std::pmr::memory_resource &other ) const noexcept { return this == &other; }
+
+public:
+  static const std::size_t chunkSize = 2 << 20, pageSize = 4096;
+
+  // What to ask of a monotonic_buffer_resource first, so that with the header it adds its buffer
+  // still fits into one chunk
+  static const std::size_t bufferSize = chunkSize - pageSize;
+
+  chunkResource_c() : _mapped( 0 ), _notHuge( 0 ), _notPlaced( 0 ) {}
+  unsigned long long mapped() const { return _mapped; }
+
+  // How the chunks are placed, for --stats
+  std::string placement()
+  {
+    std::ostringstream text;
+    unsigned long long huge = 0, kilobytes;
+    std::ifstream rollup( "/proc/self/smaps_rollup" );
+    std::string field;
+    while ( rollup >> field >> kilobytes )
+    {
+      if ( field == "AnonHugePages:" || field == "Private_Hugetlb:" )
+        huge += kilobytes;
+      rollup.ignore( std::numeric_limits< std::streamsize >::max(), '\n' );
+    }
+    text << huge / 1024 << " MiB on huge pages";
+    if ( _notHuge )
+      text << " (" << _notHuge << " chunks could not get them)";
+
+    std::map< int, unsigned long long > perNode;
+    std::lock_guard< std::mutex > lock( _mutex );
+    for ( std::size_t i = 0; i < _chunks.size(); ++i )
+    {
+      int node = -1;
+      if ( syscall( SYS_get_mempolicy, &node, 0, 0, _chunks[ i ].first, mpolFlagNode | mpolFlagAddress ) != 0 )
+        node = -1;
+      perNode[ node ] += _chunks[ i ].second;
+    }
+    text << ", node arena by NUMA node:";
+    for ( std::map< int, unsigned long long >::const_iterator it = perNode.begin(); it != perNode.end(); ++it )
+    {
+      if ( it->first < 0 )
+        text << " unknown ";
+      else
+        text << " " << it->first << ": ";
+      text << it->second / 1048576 << " MiB";
+    }
+    if ( _notPlaced )
+      text << " (" << _notPlaced << " chunks could not be placed)";
+    return text.str();
+  }
+};
+
+static chunkResource_c chunks;
+
+/*
+  The children of all nodes of an extendedTrie_c are allocated from nodeResource, which main() points to an arena
+  on top of the chunks unless nodes are dropped before the end. The allocator itself is stateless,
+  so that maps are no larger than with std::allocator.
+*/
+static std::pmr::memory_resource *nodeResource = std::pmr::new_delete_resource();
+
+template< typename value_t >
+struct nodeAllocator_t
+{
+  typedef value_t value_type;
+
+  nodeAllocator_t() {}
+  template< typename other_t > nodeAllocator_t( const nodeAllocator_t< other_t >& ) {}
+
+  value_t *allocate( std::size_t n )
+  {
+    return static_cast< value_t* >( nodeResource->allocate( n * sizeof( value_t ), alignof( value_t ) ) );
+  }
+  void deallocate( value_t *p, std::size_t n )
+  {
+    nodeResource->deallocate( p, n * sizeof( value_t ), alignof( value_t ) );
+  }
+
+  bool operator==( const nodeAllocator_t& ) const { return true; }
+  bool operator!=( const nodeAllocator_t& ) const { return false; }
+};
+
+/*
+  What the nodes of an extendedTrie_c carry besides their count: the data that only some options
+  need and the pruning round in which the node was created. The count of the node goes into the gap
+  after the round. Nodes own their data and are never copied. As every node has one, they are
+  counted here.
+
+  The data of a node is one block, allocated once it is needed, with a part for each option given.
+  Options that are not given take no memory, e.g. a node that only has a score with --half-life
+  costs a decayedCount_c and nothing else. Where the parts go is set by layOut() once the options
+  are known.
+*/
+class nodeExtra_c
+{
+  char *_data;
+  unsigned int _born;
+
+  static unsigned long long _nodes, _dataBytes;
+  static const std::size_t absent = std::numeric_limits< std::size_t >::max();
+  // Where the parts are, the size of the block, and the bytes a block takes with the ring of --window
+  static std::size_t _distinctAt, _windowAt, _decayedAt, _renderAt, _dataSize, _dataCost;
+
+  nodeExtra_c( const nodeExtra_c & );
+  nodeExtra_c& operator=( const nodeExtra_c & );
+
+  // Reserve the next part of the data for a part_t, if it is needed
+  template< typename part_t >
+  static void place( bool needed, std::size_t &at )
+  {
+    at = needed ? _dataSize : absent;
+    if ( needed )
+      _dataSize += ( sizeof( part_t ) + alignof( std::max_align_t ) - 1 ) / alignof( std::max_align_t ) *
+                   alignof( std::max_align_t );
+  }
+
+  template< typename part_t >
+  part_t &part( std::size_t at )
+  {
+    assert( at != absent );
+    if ( !_data )
+    {
+      _data = static_cast< char* >( ::operator new( _dataSize ) );
+      _dataBytes += _dataCost;
+      if ( _distinctAt != absent )
+        new ( _data + _distinctAt ) distinctData_c;
+      if ( _windowAt != absent )
+        new ( _data + _windowAt ) windowCounts_c;
+      if ( _decayedAt != absent )
+        new ( _data + _decayedAt ) decayedCount_c;
+      if ( _renderAt != absent )
+        new ( _data + _renderAt ) renderState_c;
+    }
+    return *reinterpret_cast< part_t* >( _data + at );
+  }
+
+  template< typename part_t >
+  const part_t *part( std::size_t at ) const
+  {
+    return _data && at != absent ? reinterpret_cast< const part_t* >( _data + at ) : 0;
+  }
+
+public:
+  nodeExtra_c() : _data( 0 ), _born( pruneThresholds.size() - 1 ) { ++_nodes; }
+  ~nodeExtra_c()
+  {
+    if ( _data )
+    {
+      _dataBytes -= dataFootprint();
+      if ( _distinctAt != absent )
+        part< distinctData_c >( _distinctAt ).~distinctData_c();
+      if ( _windowAt != absent )
+        part< windowCounts_c >( _windowAt ).~windowCounts_c();
+      if ( _decayedAt != absent )
+        part< decayedCount_c >( _decayedAt ).~decayedCount_c();
+      if ( _renderAt != absent )
+        part< renderState_c >( _renderAt ).~renderState_c();
+      ::operator delete( _data );
+    }
+    --_nodes;
+  }
+  unsigned long long error() const   { return pruneThresholds[ _born ]; }
+
+  // Number of nodes that currently exist
+  static unsigned long long nodes()  { return _nodes; }
+
+  // Bytes that the data of all nodes takes from the heap, and that of this node
+  static unsigned long long dataBytes() { return _dataBytes; }
+  std::size_t dataFootprint() const
+  {
+    if ( !_data )
+      return 0;
+    return _dataCost + ( distinct() ? distinct()->values.footprint() : 0 );
+  }
+
+  // Decide which parts the data of the nodes has, before any node gets its data
+  static void layOut()
+  {
+    _dataSize = 0;
+    place< distinctData_c >( distinctField, _distinctAt );
+    place< windowCounts_c >( windowSeconds, _windowAt );
+    place< decayedCount_c >( halfLife, _decayedAt );
+    // The scores change with time and count-min builds a new trie each time, so there is nothing to
+    // keep for them
+    place< renderState_c >( followInputs && !halfLife && !countMinSize, _renderAt );
+    _dataCost = _dataSize + ( windowSeconds ? windowBuckets * sizeof( unsigned long long ) : 0 );
+  }
+
+  // The part of an option that is given, the make...() ones allocate the data if there is none
+  distinctData_c &makeDistinct()              { return part< distinctData_c >( _distinctAt ); }
+  const distinctData_c *distinct() const      { return part< distinctData_c >( _distinctAt ); }
+  windowCounts_c &makeWindow()                { return part< windowCounts_c >( _windowAt ); }
+  const windowCounts_c *window() const        { return part< windowCounts_c >( _windowAt ); }
+
+  // Add a value to the distinct values, which may take more memory
+  void addDistinct( unsigned long long hash )
+  {
+    distinctSketch_c &values = makeDistinct().values;
+    const std::size_t before = values.footprint();
+    values.add( hash );
+    _dataBytes += values.footprint() - before;
+  }
+  decayedCount_c &makeDecayed()               { return part< decayedCount_c >( _decayedAt ); }
+  const decayedCount_c *decayed() const       { return part< decayedCount_c >( _decayedAt ); }
+
+  // With --follow, whether reports are rendered incrementally. Only the writer changes the render
+  // state once the node exists, so it can have it from a const node.
+  static bool renders()                       { return _renderAt != absent; }
+  renderState_c *rendering() const
+  {
+    return _data && _renderAt != absent ? reinterpret_cast< renderState_c* >( _data + _renderAt ) : 0;
+  }
+
+  // Something below the node has changed, so it needs to be formatted again
+  void touch()
+  {
+    if ( _renderAt != absent )
+      part< renderState_c >( _renderAt ).dirty = true;
+  }
+};
+
+unsigned long long nodeExtra_c::_nodes = 0;
+unsigned long long nodeExtra_c::_dataBytes = 0;
+std::size_t nodeExtra_c::_distinctAt = nodeExtra_c::absent;
+std::size_t nodeExtra_c::_windowAt = nodeExtra_c::absent;
+std::size_t nodeExtra_c::_decayedAt = nodeExtra_c::absent;
+std::size_t nodeExtra_c::_renderAt = nodeExtra_c::absent;
+std::size_t nodeExtra_c::_dataSize = 0;
+std::size_t nodeExtra_c::_dataCost = 0;
+
+/*
+  Options that keep more than counts use libstree's basicTrie_c as well, with nodes that are a
+  nodeExtra_c. The engines work on its nodes directly.
+*/
+typedef basicTrie_c< char, counter_c, nodeAllocator_t, nodeExtra_c > extendedTrie_c;
+typedef extendedTrie_c::node_t charNode_t;
+typedef extendedTrie_c::children_t charNodes_t;
+
+// Approximate size of a node including the bookkeeping of the std::map it lives in
+const std::size_t bytesPerNode = sizeof( charNodes_t::value_type ) + 4 * sizeof( void* );
+
+// Approximate memory of all nodes, including their data
+unsigned long long trieBytes()
+{
+  return nodeExtra_c::nodes() * bytesPerNode + nodeExtra_c::dataBytes();
+}
+
+/*
+  With --follow, the tree is written again and again. To make that cheap when little has changed,
+  each report is kept until the next one, and every node knows where its output is in it, see
+  renderState_c. Whatever changes a node (a string passing through, counts leaving the window,
+  pruning below it) marks the node and thereby all nodes above it dirty. dump() copies the output of
+  clean nodes from the previous report, at any depth, and only formats the dirty ones again.
+*/
+class renderCache_c
+{
+  // A node being formatted, with where its output starts in this report and was in the previous one
+  struct open_t
+  {
+    unsigned long long text;
+    std::size_t start;
+    unsigned long long previousText;
+    std::size_t previous; // npos if it is not in the previous report
+  };
+
+  std::string _previous;
+  std::ostringstream _report;
+  std::vector< open_t > _open;
+  unsigned long long _texts;
+  unsigned long long _rootText;
+
+public:
+  renderCache_c() : _texts( 0 ), _rootText( 0 ) {}
+
+  // Write a report to 'out' by calling 'format', which writes the root to 'out'
+  template< typename function_t >
+  void report( std::ostream &out, function_t format )
+  {
+    const open_t root = { ++_texts, 0, _rootText, _rootText ? 0 : std::string::npos };
+    _open.push_back( root );
+    std::streambuf *target = out.rdbuf( _report.rdbuf() );
+    format();
+    out.rdbuf( target );
+    _open.pop_back();
+    _rootText = root.text;
+    _previous = _report.str();
+    _report.str( "" );
+    out << _previous;
+  }
+
+  // Write a child of the node being formatted, either from the previous report or by calling
+  // 'format'
+  template< typename function_t >
+  void child( renderState_c &state, function_t format )
+  {
+    const std::size_t start = _report.tellp();
+    const bool shown = _open.back().previous != std::string::npos &&
+                       state.within == _open.back().previousText;
+    if ( shown && !state.dirty )
+      _report.write( _previous.data() + _open.back().previous + state.offset, state.length );
+    else
+    {
+      const open_t open = { ++_texts, start, state.text,
+                            shown ? _open.back().previous + state.offset : std::string::npos };
+      _open.push_back( open );
+      format();
+      _open.pop_back();
+      state.text = open.text;
+      state.dirty = false;
+    }
+    state.within = _open.back().text;
+    state.offset = start - _open.back().start;
+    state.length = std::size_t( _report.tellp() ) - start;
+  }
+};
+static renderCache_c *renderCache = 0;
+
+/*
+  Collect the counts (including their possible error) of all leaves below root, each with the bytes
+  that dropping it would free. The nodes still to be looked at are kept on a stack of their own,
+  rather than recursing once per byte of the longest string.
+*/
+void collectLeafWeights( const charNode_t &root,
+                         std::vector< std::pair< unsigned long long, unsigned long long > > &weights )
+{
+  std::vector< const charNode_t* > open( 1, &root );
+  while ( !open.empty() )
+  {
+    const charNode_t &node = *open.back();
+    open.pop_back();
+    for ( charNodes_t::const_iterator it = node.next.begin(); it != node.next.end(); ++it )
+      if ( it->second.next.empty() )
+        weights.push_back( std::make_pair( it->second.count.value() + it->second.error(),
+                                           bytesPerNode + it->second.dataFootprint() ) );
+      else
+        open.push_back( &it->second );
+  }
+}
+
+/*
+  Remove all nodes below 'root' that have been counted at most 'threshold' times, including their
+  error, unless they still have children. Their parent has counted them anyway, so the strings in
+  question now seem to end there. Returns if anything was removed. The nodes on the way are kept on
+  a stack, each with the child it is in, which is decided on once that child is done.
+*/
+bool prune( charNode_t &root, unsigned long long threshold )
+{
+  struct open_t
+  {
+    charNode_t *node;
+    charNodes_t::iterator next;
+    bool pruned;
+  };
+  const open_t first = { &root, root.next.begin(), false };
+  std::vector< open_t > open( 1, first );
+  while ( true )
+  {
+    open_t &last = open.back();
+    if ( last.next != last.node->next.end() )
+    {
+      charNode_t &child = last.next->second;
+      const open_t below = { &child, child.next.begin(), false };
+      open.push_back( below );
+      continue;
+    }
+    const bool pruned = last.pruned;
+    if ( pruned )
+      last.node->touch();
+    open.pop_back();
+    if ( open.empty() )
+      return pruned;
+
+    open_t &parent = open.back();
+    charNode_t &child = parent.next->second;
+    parent.pruned |= pruned;
+    if ( child.next.empty() && child.count.value() + child.error() <= threshold )
+    {
+      parent.node->next.erase( parent.next++ );
+      parent.pruned = true;
+    }
+    else
+      ++parent.next;
+  }
+}
+
+/*
+  Bring the trie down to three quarters of memoryCap by dropping the least frequent leaves, so that
+  pruning happens rarely. Every round picks a threshold that drops leaves of enough bytes, though
+  their parents may then become leaves that are dropped as well. Leaves with much data, such as a
+  HyperLogLog sketch, count for more than one.
+*/
+void enforceMemoryCap( charNode_t &root )
+{
+  const unsigned long long target = memoryCap / 4 * 3;
+  while ( trieBytes() > target && !root.next.empty() )
+  {
+    std::vector< std::pair< unsigned long long, unsigned long long > > weights;
+    collectLeafWeights( root, weights );
+    std::sort( weights.begin(), weights.end() );
+    const unsigned long long excess = trieBytes() - target;
+    std::size_t last = 0;
+    for ( unsigned long long freed = weights[ 0 ].second; freed < excess && last + 1 < weights.size(); )
+      freed += weights[ ++last ].second;
+    pruneThresholds.push_back( std::max( weights[ last ].first, pruneThresholds.back() ) );
+    prune( root, pruneThresholds.back() );
+  }
+}
+
+/*
+  Count a string of time 'bucket' in the window of node. The count of the node is kept equal to the
+  sum of its ring, so that everybody else can ignore the window.
+*/
+void countInWindow( charNode_t &node, long long bucket )
+{
+  windowCounts_c &window = node.makeWindow();
+  const unsigned long long expired = window.advance( bucket );
+  node.count.set( node.count.value() - expired );
+  window.add( bucket );
+  node.count.add( 1 );
+}
+
+/*
+  Move the windows of all nodes of 'trie' forward to newestBucket and remove the nodes that have
+  nothing left in their window. Their descendants can not have anything left either. The nodes on
+  the way are kept on a stack, each with the child to look at next, and removed subtrees are torn
+  down by removeChildren(), so that neither recurses once per byte of the longest string.
+*/
+void expireWindow( extendedTrie_c &trie )
+{
+  charNode_t &root = trie.root();
+  root.count.set( root.count.value() - root.makeWindow().advance( newestBucket ) );
+  std::vector< std::pair< charNode_t*, charNodes_t::iterator > > path;
+  path.push_back( std::make_pair( &root, root.next.begin() ) );
+  while ( !path.empty() )
+  {
+    charNode_t &node = *path.back().first;
+    charNodes_t::iterator &it = path.back().second;
+    if ( it == node.next.end() )
+    {
+      path.pop_back();
+      continue;
+    }
+
+    charNode_t &child = it->second;
+    const unsigned long long expired = child.makeWindow().advance( newestBucket );
+    child.count.set( child.count.value() - expired );
+    if ( expired )
+      child.touch();
+    if ( child.count.value() )
+    {
+      ++it;
+      path.push_back( std::make_pair( &child, child.next.begin() ) );
+    }
+    else
+    {
+      trie.removeChildren( child );
+      node.next.erase( it++ );
+    }
+  }
+}
+
+double decayedScore( const charNode_t &node )
+{
+  return node.decayed() ? node.decayed()->at( newestTime ) : 0;
+}
+
+/*
+  Everything that consumes the input strings is a lineSink_c, so that the readers below can feed
+  any of the engines.
+*/
+class lineSink_c
+{
+public:
+  virtual ~lineSink_c() {}
+  virtual void add( std::string &line ) = 0;
+
+  // The same, from the given one of several workers adding at once
+  virtual void addFrom( std::string &line, unsigned int ) { add( line ); }
+
+  // Write the tree of everything added so far
+  virtual void report( std::ostream &out ) = 0;
+
+  // Write everything added so far for a checkpoint, if possible
+  virtual bool save( std::ostream & ) { return false; }
+};
+
+/*
+  Write the tree to snapshotFile without holding up the reader: A forked child gets a copy-on-write
+  image of the trie as it is between two strings and writes it, while the parent goes on reading
+  and only pays for the pages it changes meanwhile.
+*/
+void takeSnapshot( lineSink_c &sink )
+{
+  snapshotRequested = 0;
+
+  // Reap earlier snapshots
+  while ( waitpid( -1, 0, WNOHANG ) > 0 )
+    ;
+
+  const pid_t pid = fork();
+  if ( pid < 0 )
+    std::cerr << "stree: can not fork for the snapshot\n";
+  if ( pid != 0 )
+    return;
+
+  const std::string temporary = snapshotFile + ".tmp";
+  std::ofstream out( temporary.c_str() );
+  sink.report( out );
+  out.close();
+  if ( !out || rename( temporary.c_str(), snapshotFile.c_str() ) != 0 )
+  {
+    std::cerr << "stree: can not write " << snapshotFile << "\n";
+    _exit( 1 );
+  }
+  _exit( 0 );
+}
+
+void writeVarint( std::ostream &out, unsigned long long value )
+{
+  while ( value >= 0x80 )
+  {
+    out.put( static_cast< char >( value | 0x80 ) );
+    value >>= 7;
+  }
+  out.put( static_cast< char >( value ) );
+}
+
+void writeVarint( std::string &out, unsigned long long value )
+{
+  while ( value >= 0x80 )
+  {
+    out += static_cast< char >( value | 0x80 );
+    value >>= 7;
+  }
+  out += static_cast< char >( value );
+}
+
+bool readVarint( std::istream &in, unsigned long long &value )
+{
+  value = 0;
+  for ( int shift = 0; shift < 64; shift += 7 )
+  {
+    char c;
+    if ( !in.get( c ) )
+      return false;
+    value |= static_cast< unsigned long long >( c & 0x7f ) << shift;
+    if ( !( c & 0x80 ) )
+      return true;
+  }
+  return false;
+}
+
+// For buffers in memory that are known to be complete. Returns the position after the number.
+const char *readVarint( const char *p, unsigned long long &value )
+{
+  value = 0;
+  int shift = 0;
+  for ( ; *p & 0x80; shift += 7 )
+    value |= static_cast< unsigned long long >( *p++ & 0x7f ) << shift;
+  value |= static_cast< unsigned long long >( static_cast< unsigned char >( *p++ ) ) << shift;
+  return p;
+}
+
+/*
+  A trie is saved in preorder, each node as its count and number of children, followed by the
+  character and the subtree of each child. Both ways keep the nodes on the way on a stack of their
+  own, rather than recursing once per byte of the longest string.
+*/
+void saveTrie( std::ostream &out, const charNode_t &root )
+{
+  std::vector< std::pair< const charNode_t*, charNodes_t::const_iterator > > open;
+  writeVarint( out, root.count.value() );
+  writeVarint( out, root.next.size() );
+  open.push_back( std::make_pair( &root, root.next.begin() ) );
+  while ( !open.empty() )
+  {
+    charNodes_t::const_iterator &next = open.back().second;
+    if ( next == open.back().first->next.end() )
+    {
+      open.pop_back();
+      continue;
+    }
+    const charNode_t &child = next->second;
+    out.put( next->first );
+    ++next;
+    writeVarint( out, child.count.value() );
+    writeVarint( out, child.next.size() );
+    open.push_back( std::make_pair( &child, child.next.begin() ) );
+  }
+}
+
+// The longest string a checkpoint may hold, anything deeper is taken for a broken file
+const std::size_t checkpointDepth = 1 << 26;
+
+bool loadTrie( std::istream &in, charNode_t &root )
+{
+  // The nodes on the way, each with the number of its children still to be read
+  std::vector< std::pair< charNode_t*, unsigned long long > > open;
+  charNode_t *node = &root;
+  while ( true )
+  {
+    unsigned long long count, children;
+    if ( !readVarint( in, count ) || !readVarint( in, children ) )
+      return false;
+    node->count.add( count );
+    open.push_back( std::make_pair( node, children ) );
+    while ( !open.empty() && !open.back().second )
+      open.pop_back();
+    if ( open.empty() )
+      return true;
+    if ( open.size() > checkpointDepth )
+      return false;
+
+    char c;
+    if ( !in.get( c ) )
+      return false;
+    --open.back().second;
+    node = &open.back().first->next[ c ];
+  }
+}
+
+/*
+  Write how far each input file has been read and the trie to checkpointFile. The checkpoint goes to
+  a temporary file first, so that the previous one stays intact until the new one is complete.
+*/
+bool writeCheckpoint( lineSink_c &sink )
+{
+  const std::string temporary = checkpointFile + ".tmp";
+  std::ofstream out( temporary.c_str(), std::ios::binary );
+  out << "stree checkpoint 1\n" << inputPositions.size() << "\n";
+  for ( std::size_t i = 0; i < inputPositions.size(); ++i )
+    out << inputPositions[ i ].offset << " " << inputPositions[ i ].path << "\n";
+  sink.save( out );
+  out.close();
+  if ( !out || rename( temporary.c_str(), checkpointFile.c_str() ) != 0 )
+  {
+    std::cerr << "stree: can not write " << checkpointFile << "\n";
+    return false;
+  }
+  return true;
+}
+
+static pid_t checkpointWriter = 0;
+
+/*
+  Write a checkpoint the same way as a snapshot, unless the previous one is still being written. The
+  timer will ask again.
+*/
+void takeCheckpoint( lineSink_c &sink )
+{
+  checkpointRequested = 0;
+  if ( checkpointWriter > 0 && waitpid( checkpointWriter, 0, WNOHANG ) == 0 )
+    return;
+
+  checkpointWriter = fork();
+  if ( checkpointWriter < 0 )
+    std::cerr << "stree: can not fork for the checkpoint\n";
+  if ( checkpointWriter != 0 )
+    return;
+  _exit( writeCheckpoint( sink ) ? 0 : 1 );
+}
+
+/*
+  Once all input has been read, the last checkpoint is written right away, after any earlier one,
+  so that it covers everything when stree ends.
+*/
+void finishCheckpoints( lineSink_c &sink )
+{
+  if ( checkpointWriter > 0 )
+    waitpid( checkpointWriter, 0, 0 );
+  checkpointRequested = 0;
+  writeCheckpoint( sink );
+}
+
+/*
+  Load the trie of a checkpoint into root and let the input files start where it left off. Files
+  are matched by device and inode rather than by name, and the same files have to be given again:
+  one more or less would be counted twice or dropped.
+*/
+void resume( const std::string &path, charNode_t &root )
+{
+  std::ifstream in( path.c_str(), std::ios::binary );
+  std::string magic;
+  std::size_t files = 0;
+  getline( in, magic );
+  in >> files;
+  in.ignore();
+  std::vector< inputPosition_t > known;
+  for ( std::size_t i = 0; i < files && in; ++i )
+  {
+    inputPosition_t position;
+    in >> position.offset;
+    in.ignore();
+    getline( in, position.path );
+    known.push_back( position );
+  }
+  if ( magic != "stree checkpoint 1" || !in || !loadTrie( in, root ) )
+  {
+    std::cerr << "stree: " << path << " is not a checkpoint\n";
+    exit( 1 );
+  }
+
+  std::vector< bool > matched( known.size(), false );
+  const std::string *unknown = 0;
+  for ( std::size_t i = 0; i < inputPositions.size(); ++i )
+  {
+    // A file that can not be looked at matches none of the checkpoint
+    struct stat given;
+    std::size_t k = stat( inputPositions[ i ].path.c_str(), &given ) == 0 ? 0 : known.size();
+    for ( struct stat st; k < known.size(); ++k )
+      if ( !matched[ k ] && stat( known[ k ].path.c_str(), &st ) == 0 &&
+           st.st_dev == given.st_dev && st.st_ino == given.st_ino )
+        break;
+    if ( k == known.size() )
+    {
+      if ( !unknown )
+        unknown = &inputPositions[ i ].path;
+      continue;
+    }
+    matched[ k ] = true;
+    inputPositions[ i ].offset = known[ k ].offset;
+  }
+  for ( std::size_t k = 0; k < known.size(); ++k )
+    if ( !matched[ k ] )
+    {
+      std::cerr << "stree: " << known[ k ].path << " of checkpoint " << path << " is not given\n";
+      exit( 1 );
+    }
+  if ( unknown )
+  {
+    std::cerr << "stree: " << *unknown << " is not in checkpoint " << path << "\n";
+    exit( 1 );
+  }
+}
+
+/*
+  Called by the readers between two strings once a signal has asked for something.
+*/
+void handleRequests( lineSink_c &sink )
+{
+  if ( snapshotRequested )
+    takeSnapshot( sink );
+  if ( checkpointRequested )
+    takeCheckpoint( sink );
+}
+
+/*
+  The default engine: Enter each string into the trie.
+*/
+class trieSink_c : public lineSink_c
+{
+protected:
+  extendedTrie_c &_trie;
+  charNode_t &_root;
+  std::string _value, _time;
+  double _now;
+  long long _bucket, _sweptBucket;
+
+  void countNode( charNode_t &node )
+  {
+    if ( windowSeconds )
+      countInWindow( node, _bucket );
+    else
+      node.count.add( 1 );
+    if ( halfLife )
+      node.makeDecayed().add( _now );
+  }
+
+public:
+  trieSink_c( extendedTrie_c &trie ) : _trie( trie ), _root( trie.root() ), _now( 0 ), _bucket( 0 ), _sweptBucket( newestBucket ) {}
+
+  void report( std::ostream &out );
+
+  bool save( std::ostream &out )
+  {
+    saveTrie( out, _root );
+    return true;
+  }
+
+  void add( std::string &s )
+  {
+    // Cut fields from the back, so that the numbers of the others stay valid
+    bool hasValue = distinctField > timeField && cutField( s, distinctField, _value );
+    const bool hasTime = timeField && cutField( s, timeField, _time );
+    if ( distinctField && distinctField < timeField )
+      hasValue = cutField( s, distinctField, _value );
+
+    if ( windowSeconds || halfLife )
+    {
+      if ( timeField )
+      {
+        if ( !hasTime || !parseTime( _time, _now ) )
+          return;
+      }
+      else
+        _now = std::time( 0 );
+      newestTime = std::max( newestTime, _now );
+    }
+
+    if ( windowSeconds )
+    {
+      _bucket = windowBucket( _now );
+      newestBucket = std::max( newestBucket, _bucket );
+      if ( _bucket <= newestBucket - windowBuckets )
+        return; // too late to be counted
+
+      // Every full window, drop what has expired even if it has not been accessed
+      if ( newestBucket >= _sweptBucket + windowBuckets )
+      {
+        expireWindow( _trie );
+        _sweptBucket = newestBucket;
+      }
+    }
+
+    charNode_t *current = &_root;
+    countNode( *current );
+    for ( std::size_t i = 0; i < s.length(); ++i )
+    {
+      // Enter the string while counting the charcters
+      current = &current->next[ s[ i ] ];
+      countNode( *current );
+      current->touch();
+    }
+    if ( hasValue )
+      current->addDistinct( hash64( _value.data(), _value.length() ) );
+    if ( memoryCap && trieBytes() > memoryCap )
+      enforceMemoryCap( _root );
+  }
+};
+
+/*
+  Unless an option needs more than counts, the strings go into libstree's basicTrie_c, instantiated
+  for bytes, counter_c's that take 32 bits until they need more, and children allocated from the
+  node arena. Its nodes keep their rank for --relayout, next to the counter_c in what would be
+  padding.
+*/
+typedef basicTrie_c< char, counter_c, std::pmr::polymorphic_allocator, orderedExtra_t > countingTrie_c;
+
+/*
+  All tries of stree are written by this visitor, with the columns of countColumns(). Those of a
+  extendedTrie_c also show its distinct values, score or error, so its walk sets 'node' before entering
+  it.
+*/
+class countFormattingVisitor_c : public formattingVisitor_c
+{
+  std::ostream &_out;
+
+public:
+  const charNode_t *node;
+
+  countFormattingVisitor_c( std::ostream &out ) : formattingVisitor_c( out, format ), _out( out ), node( 0 ) {}
+
+  std::vector< std::string > columns( unsigned long long count ) const;
+
+  std::ostream &out() { return _out; }
+
+  // Enter a child by calling 'visit' without the separator that may go before it, e.g. to write it
+  // somewhere else
+  template< typename function_t >
+  void alone( function_t visit )
+  {
+    const std::size_t entered = _open.back().second;
+    _open.back().second = 0;
+    visit();
+    _open.back().second = entered;
+  }
+
+  // Enter a child whose output is written by the caller, or by alone()
+  void separate()
+  {
+    if ( _open.back().second++ )
+      _formatter.separator();
+  }
+};
+
+/*
+  Strings are entered a batch at a time, see basicTrie_c::insert().
+
+  With --relayout, the trie is copied to a new arena in the order it is written in before writing
+  it. Writing then reads the nodes from front to back, rather than in the order the strings happened
+  to come in. Like the trie in main(), the old trie and its arena are left as they are: destroying
+  the trie would take another walk through all of it. Its memory is never used again, so the side
+  table entries of counter_c for its counters that have grown beyond 32 bits can not be mistaken
+  for those of new nodes.
+*/
+class countingTrieSink_c : public lineSink_c
+{
+  static const std::size_t batchSize = 16;
+
+  std::pmr::memory_resource *_arena;
+  countingTrie_c *_trie;
+  std::string _batch[ batchSize ];
+  std::size_t _batched;
+
+  void flush()
+  {
+    std::string_view strings[ batchSize ];
+    for ( std::size_t i = 0; i < _batched; ++i )
+      strings[ i ] = _batch[ i ];
+    _trie->insert( strings, _batched );
+    _batched = 0;
+  }
+
+  static std::pmr::memory_resource *newArena()
+  {
+    return new std::pmr::monotonic_buffer_resource( chunkResource_c::bufferSize, &chunks );
+  }
+
+  void relayout()
+  {
+    std::pmr::memory_resource *arena = newArena();
+    _trie = new countingTrie_c( *_trie, format.sortByFrequency(), arena );
+    _arena = arena;
+  }
+
+  // With --top, each node on a line of its own, however the tree would be written
+  void writeTop( std::ostream &out );
+
+public:
+  countingTrieSink_c() : _arena( newArena() ), _trie( new countingTrie_c( _arena ) ), _batched( 0 ) {}
+
+  void add( std::string &s )
+  {
+    // The reader reuses whatever buffer it gets back
+    _batch[ _batched++ ].swap( s );
+    if ( _batched == batchSize )
+      flush();
+  }
+
+  void report( std::ostream &out )
+  {
+    flush();
+    if ( topCount )
+    {
+      writeTop( out );
+      return;
+    }
+    if ( relayoutTrie )
+      relayout();
+    countFormattingVisitor_c formatter( out );
+    _trie->visit( formatter, format.sortByFrequency() );
+  }
+};
+
+/*
+  With --sample, the number of strings to skip before the next one is used is geometrically
+  distributed. Drawing it once per used string is much cheaper than a coin flip per string, and the
+  skipped ones need not even be looked at apart from finding their end. There is one sampler for
+  all input, so that each file gets its own skips rather than the same ones again, which the
+  confidence intervals of --sample-ci rely on.
+*/
+class sampler_c
+{
+  std::mt19937_64 _random;
+  std::geometric_distribution< unsigned long long > _skip;
+
+public:
+  sampler_c( unsigned long long seed ) : _random( seed ), _skip( sampleRate ) {}
+  unsigned long long skip() { return sampleRate < 1 ? _skip( _random ) : 0; }
+};
+
+/*
+  Read the strings of a pipe or terminal. While no input is waiting, stree waits for it together
+  with the signals, so that a snapshot or checkpoint is taken right away rather than with the next
+  string.
+*/
+void readLines( int fd, lineSink_c &sink, sampler_c &sampler )
+{
+  unsigned long long skip = sampler.skip();
+  char buffer[ 1 << 16 ];
+  std::string pending, s;
+  while ( true )
+  {
+    if ( snapshotRequested || checkpointRequested )
+      handleRequests( sink );
+    if ( !waitForInput( fd ) )
+      continue;
+    const ssize_t n = read( fd, buffer, sizeof buffer );
+    if ( n < 0 && ( errno == EINTR || errno == EAGAIN ) )
+      continue;
+    if ( n <= 0 )
+      break;
+    pending.append( buffer, n );
+    std::string::size_type begin = 0, newline;
+    while ( ( newline = pending.find( '\n', begin ) ) != std::string::npos )
+    {
+      if ( skip )
+        --skip;
+      else
+      {
+        s.assign( pending, begin, newline - begin );
+        if ( snapshotRequested || checkpointRequested )
+          handleRequests( sink );
+        sink.add( s );
+        skip = sampler.skip();
+      }
+      begin = newline + 1;
+    }
+    pending.erase( 0, begin );
+  }
+  if ( !pending.empty() && !skip )
+    sink.add( pending );
+}
+
+/*
+  Files are mapped into memory if possible, which saves copying them through a stream buffer and
+  lets skipped strings cost no more than a memchr().
+*/
+void readFile( inputPosition_t &position, lineSink_c &sink, sampler_c &sampler )
+{
+  const char *path = position.path.c_str();
+  const int fd = open( path, O_RDONLY );
+  struct stat st;
+  if ( fd < 0 || fstat( fd, &st ) != 0 )
+  {
+    std::cerr << "stree: can not read " << path << "\n";
+    if ( fd >= 0 )
+      close( fd );
+    return;
+  }
+  void *mapped = st.st_size ? mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 ) : MAP_FAILED;
+  close( fd );
+  if ( mapped == MAP_FAILED )
+  {
+    // Not a regular file, or empty
+    const int fd = open( path, O_RDONLY );
+    if ( fd < 0 )
+    {
+      std::cerr << "stree: can not read " << path << "\n";
+      return;
+    }
+    readLines( fd, sink, sampler );
+    close( fd );
+    return;
+  }
+  madvise( mapped, st.st_size, MADV_SEQUENTIAL );
+
+  std::string s;
+  const char *begin = static_cast< const char* >( mapped );
+  const char *end = begin + st.st_size;
+  const char *p = begin + std::min< unsigned long long >( position.offset, st.st_size );
+  while ( p < end )
+  {
+    for ( unsigned long long skip = sampler.skip(); skip && p < end; --skip )
+    {
+      const char *newline = static_cast< const char* >( memchr( p, '\n', end - p ) );
+      p = newline ? newline + 1 : end;
+    }
+    if ( p == end )
+      break;
+    const char *newline = static_cast< const char* >( memchr( p, '\n', end - p ) );
+    const char *lineEnd = newline ? newline : end;
+    s.assign( p, lineEnd );
+    if ( snapshotRequested || checkpointRequested )
+    {
+      position.offset = p - begin;
+      handleRequests( sink );
+    }
+    sink.add( s );
+    p = lineEnd + 1;
+  }
+  position.offset = st.st_size;
+  munmap( mapped, st.st_size );
+}
+
+/*
+  Merge the distinct values upwards: Every node that dump() is going to print gets the number of
+  distinct values of all strings below it. The union of the subtree is added to 'sketch'.
+
+  Only the sketches along the current path are alive at any time, so memory stays bounded by the
+  depth of the trie.
+*/
+void collectDistinct( charNode_t &node, distinctSketch_c &sketch )
+{
+  // Nodes that dump() merges with their only child share its values
+  if ( node.next.size() == 1 && node.next.begin()->second.count.value() == node.count.value() )
+  {
+    collectDistinct( node.next.begin()->second, sketch );
+    return;
+  }
+
+  distinctSketch_c below;
+  if ( node.distinct() )
+    below.merge( node.distinct()->values );
+  for ( charNodes_t::iterator it = node.next.begin(); it != node.next.end(); ++it )
+    collectDistinct( it->second, below );
+  node.makeDistinct().count = below.estimate();
+  sketch.merge( below );
+}
+
+/*
+  The count-min engine does not build a trie of the input. Every prefix of the selected depths is
+  counted in a Count-Min sketch instead, which has a fixed size. Next to it, the most frequent
+  prefixes of every depth are remembered as candidates. After reading, the candidates are put into
+  a trie, with their estimated counts, that can be dumped as usual.
+
+  The sketch uses conservative update: only the rows holding the minimum are incremented, which
+  keeps the overestimation low without affecting the error bound.
+*/
+class countMinEngine_c : public lineSink_c
+{
+  static const int rows = 4;
+  // Stale candidates refreshed by one offer() at most
+  static const int maxRefreshes = 8;
+
+  // Per depth: the candidates with their hash and the estimate seen last, and the candidates
+  // ordered by that estimate to find the one to evict.
+  typedef std::map< std::string, std::pair< unsigned long long, unsigned long long > > candidates_t;
+  typedef std::set< std::pair< unsigned long long, std::string > > byEstimate_t;
+
+  std::size_t _width;
+  std::vector< unsigned long long > _cells;
+  std::size_t _maxCandidates;
+  std::vector< candidates_t > _candidates;
+  std::vector< byEstimate_t > _byEstimate;
+  unsigned long long _lines;
+  unsigned long long _updates;
+
+  // Row i uses the double hash h1 + i * h2 to find its counter
+  unsigned long long& cell( int row, unsigned long long hash )
+  {
+    const unsigned long long h1 = hash & 0xffffffffULL, h2 = hash >> 32;
+    return _cells[ row * _width + ( h1 + row * h2 ) % _width ];
+  }
+
+  unsigned long long query( unsigned long long hash )
+  {
+    unsigned long long minimum = cell( 0, hash );
+    for ( int row = 1; row < rows; ++row )
+      minimum = std::min( minimum, cell( row, hash ) );
+    return minimum;
+  }
+
+  unsigned long long update( unsigned long long hash )
+  {
+    const unsigned long long estimate = query( hash ) + 1;
+    for ( int row = 0; row < rows; ++row )
+      cell( row, hash ) = std::max( cell( row, hash ), estimate );
+    ++_updates;
+    return estimate;
+  }
+
+  void offer( std::size_t depth, const std::string &line, unsigned long long hash,
+              unsigned long long estimate )
+  {
+    candidates_t &candidates = _candidates[ depth ];
+    byEstimate_t &byEstimate = _byEstimate[ depth ];
+
+    // Most prefixes are rare, do not bother looking them up. Known candidates that are skipped here
+    // get their estimate refreshed when they are about to be evicted.
+    if ( candidates.size() == _maxCandidates && estimate <= byEstimate.begin()->first )
+      return;
+
+    const std::string prefix( line, 0, countMinDepths[ depth ] );
+    candidates_t::iterator it = candidates.find( prefix );
+    if ( it != candidates.end() )
+    {
+      byEstimate.erase( std::make_pair( it->second.second, prefix ) );
+      it->second.second = estimate;
+      byEstimate.insert( std::make_pair( estimate, prefix ) );
+      return;
+    }
+
+    // Refreshing is bounded, so that no string takes long. If there are more stale candidates, the
+    // prefix is not taken this time, but offered again with a higher estimate when it comes again.
+    for ( int refreshed = 0; candidates.size() == _maxCandidates; )
+    {
+      const std::pair< unsigned long long, std::string > weakest = *byEstimate.begin();
+      candidates_t::iterator w = candidates.find( weakest.second );
+      const unsigned long long current = query( w->second.first );
+      if ( current != weakest.first )
+      {
+        // Stale, it has been counted since
+        if ( ++refreshed > maxRefreshes )
+          return;
+        byEstimate.erase( byEstimate.begin() );
+        w->second.second = current;
+        byEstimate.insert( std::make_pair( current, weakest.second ) );
+        continue;
+      }
+      if ( estimate <= current )
+        return;
+      byEstimate.erase( byEstimate.begin() );
+      candidates.erase( w );
+    }
+    candidates[ prefix ] = std::make_pair( hash, estimate );
+    byEstimate.insert( std::make_pair( estimate, prefix ) );
+  }
+
+  typedef std::vector< std::pair< std::string, charNode_t* > > below_t;
+
+  static bool sketched( std::size_t depth )
+  {
+    return std::binary_search( countMinDepths.begin(), countMinDepths.end(), depth );
+  }
+
+  static bool byCount( const below_t::value_type &lhs, const below_t::value_type &rhs )
+  {
+    return lhs.second->count.value() > rhs.second->count.value();
+  }
+
+  /*
+    The nodes of the next sketched depths below a node of depth 'depth', in alphabetical order, each
+    with the characters that lead there from that node. The nodes in between have no count.
+  */
+  static void below( charNode_t &node, std::size_t depth, const std::string &label, below_t &nodes )
+  {
+    for ( charNodes_t::iterator it = node.next.begin(); it != node.next.end(); ++it )
+    {
+      const std::string next = label + it->first;
+      if ( sketched( depth + next.length() ) )
+        nodes.push_back( std::make_pair( next, &it->second ) );
+      else
+        below( it->second, depth, next, nodes );
+    }
+  }
+
+  /*
+    Give every node of a sketched depth its estimate.
+  */
+  void estimate( charNode_t &node, std::string &prefix )
+  {
+    if ( sketched( prefix.length() ) )
+    {
+      unsigned long long h = fnvBasis;
+      for ( std::size_t i = 0; i < prefix.length(); ++i )
+        h = fnvStep( h, prefix[ i ] );
+      node.count.set( query( mix64( h ) ) );
+    }
+    for ( charNodes_t::iterator it = node.next.begin(); it != node.next.end(); ++it )
+    {
+      prefix += it->first;
+      estimate( it->second, prefix );
+      prefix.resize( prefix.length() - 1 );
+    }
+  }
+
+  /*
+    Make the count of every node at least the sum of its children, as counts of prefixes are.
+    Raising an estimate does not make it too low.
+  */
+  static unsigned long long settle( charNode_t &node, std::size_t depth )
+  {
+    below_t children;
+    below( node, depth, "", children );
+    unsigned long long sum = 0;
+    for ( std::size_t i = 0; i < children.size(); ++i )
+      sum += settle( *children[ i ].second, depth + children[ i ].first.length() );
+    if ( node.count.value() < sum )
+      node.count.add( sum - node.count.value() );
+    return node.count.value();
+  }
+
+  /*
+    Overestimated children must not exceed their parent, whose count is at least theirs.
+  */
+  static void clamp( charNode_t &node, std::size_t depth )
+  {
+    below_t children;
+    below( node, depth, "", children );
+    for ( std::size_t i = 0; i < children.size(); ++i )
+    {
+      if ( children[ i ].second->count.value() > node.count.value() )
+        children[ i ].second->count.set( node.count.value() );
+      clamp( *children[ i ].second, depth + children[ i ].first.length() );
+    }
+  }
+
+  static void write( std::ostream &out, charNode_t &node, std::size_t depth, std::string current,
+                     const std::string &prefix, bool isRootNode );
+
+public:
+  countMinEngine_c( unsigned long long size ) : _lines( 0 ), _updates( 0 )
+  {
+    if ( countMinDepths.empty() )
+      for ( std::size_t depth = 1; depth <= 64; depth *= 2 )
+        countMinDepths.push_back( depth );
+
+    _width = size / 4 * 3 / rows / sizeof( unsigned long long );
+    _cells.assign( rows * _width, 0 );
+
+    // A candidate costs its prefix twice and the nodes of the map and the set
+    const std::size_t bytesPerCandidate = 2 * ( countMinDepths.back() + 96 );
+    _maxCandidates = std::max< std::size_t >( 1, size / 4 / bytesPerCandidate / countMinDepths.size() );
+    _candidates.resize( countMinDepths.size() );
+    _byEstimate.resize( countMinDepths.size() );
+  }
+
+  void add( std::string &line )
+  {
+    ++_lines;
+    unsigned long long h = fnvBasis;
+    std::size_t depth = 0;
+    for ( std::size_t i = 0; i < line.length() && depth < countMinDepths.size(); ++i )
+    {
+      h = fnvStep( h, line[ i ] );
+      if ( i + 1 == countMinDepths[ depth ] )
+      {
+        const unsigned long long hash = mix64( h );
+        offer( depth, line, hash, update( hash ) );
+        ++depth;
+      }
+    }
+  }
+
+  /*
+    Build the approximate trie from the candidates. Only the nodes of the sketched depths have
+    counts, which are never too low.
+  */
+  void reconstruct( charNode_t &root )
+  {
+    for ( std::size_t depth = 0; depth < _candidates.size(); ++depth )
+      for ( candidates_t::iterator it = _candidates[ depth ].begin(); it != _candidates[ depth ].end(); ++it )
+      {
+        charNode_t *current = &root;
+        for ( std::size_t i = 0; i < it->first.length(); ++i )
+          current = &current->next[ it->first[ i ] ];
+      }
+    std::string prefix;
+    estimate( root, prefix );
+    settle( root, 0 );
+    root.count.set( _lines );
+    clamp( root, 0 );
+  }
+
+  // Maximum overestimation of a count with a probability of 1 - e^-rows. Every depth is counted in
+  // the same rows, so the mass that collides is that of all updates, not just of the lines.
+  unsigned long long errorBound() const
+  {
+    return static_cast< unsigned long long >( std::ceil( std::exp( 1.0 ) * _updates / _width ) );
+  }
+
+  void report( std::ostream &out );
+};
+
+/*
+  The frequency of a node as written, followed by the number of distinct values if those are
+  counted and by the score with --half-life. Frequencies that may be too low are followed by their
+  maximum error.
+*/
+std::vector< std::string > countColumns( unsigned long long n, const charNode_t *node, bool exact = false )
+{
+  std::vector< std::string > columns;
+  std::ostringstream count;
+  if ( estimatedCounts && !exact )
+    count << "~";
+  if ( sampleRate < 1 )
+  {
+    // The sampled count is binomially distributed, scale it and its standard deviation
+    count << static_cast< unsigned long long >( n / sampleRate + 0.5 );
+    if ( sampleConfidence )
+      count << "+-" << static_cast< unsigned long long >(
+        std::ceil( 1.96 * std::sqrt( n * ( 1 - sampleRate ) ) / sampleRate ) );
+  }
+  else
+    count << n;
+  // The error is in sampled strings as well
+  if ( node && node->error() )
+    count << "+" << static_cast< unsigned long long >( node->error() / sampleRate + 0.5 );
+  columns.push_back( count.str() );
+  if ( distinctField )
+  {
+    std::ostringstream distinct;
+    distinct << ( node && node->distinct() ? node->distinct()->count : 0 );
+    columns.push_back( distinct.str() );
+  }
+  if ( halfLife )
+  {
+    std::ostringstream score;
+    score << std::fixed << std::setprecision( 1 ) << ( node ? decayedScore( *node ) : 0 );
+    columns.push_back( score.str() );
+  }
+  return columns;
+}
+
+std::vector< std::string > countFormattingVisitor_c::columns( unsigned long long count ) const
+{
+  return countColumns( count, node );
+}
+
+void countingTrieSink_c::writeTop( std::ostream &out )
+{
+  formatOptions_t options = format;
+  options.structureStyle = linewise;
+  options.repeatPrefix = true;
+  if ( !options.printFrequency() )
+    options.prependFrequency = true;
+  treeFormatter_c formatter( out, options );
+  const std::vector< std::pair< std::string, unsigned long long > > top = _trie->top( topCount, minDepth );
+  for ( std::size_t i = 0; i < top.size(); ++i )
+    formatter.head( top[ i ].first, "", countColumns( top[ i ].second, 0 ), false, false, true );
+}
+
+/*
+  Engines that can not hand their nodes to a countFormattingVisitor_c in order write them in three
+  parts with libstree's treeFormatter_c: writeNodeHead() before the children of a node,
+  writeNodeSeparator() between two of them and writeNodeTail() after them, so that all give the
+  same output.
+
+  'current' is the part of the string that the parent has not printed, 'prefix' is the rest. Strings
+  end at the node if 'terminal' is set, and 'node' may be null if there is no trie node for it.
+*/
+void writeNodeHead( std::ostream &out, const std::string &current, const std::string &prefix,
+                    unsigned long long count, const charNode_t *node, bool isRootNode,
+                    bool hasChildren, bool terminal, bool exact = false )
+{
+  treeFormatter_c( out, format ).head(
+    current, prefix, format.printFrequency() ? countColumns( count, node, exact ) : std::vector< std::string >(),
+    isRootNode, hasChildren, terminal );
+}
+
+void writeNodeSeparator( std::ostream &out )
+{
+  treeFormatter_c( out, format ).separator();
+}
+
+void writeNodeTail( std::ostream &out, const std::string &current, bool isRootNode,
+                    bool hasChildren )
+{
+  treeFormatter_c( out, format ).tail( current, isRootNode, hasChildren );
+}
+
+typedef childOrder_t< charNodes_t::const_iterator > charOrder_t;
+
+// Children are ordered by count, or by score with --half-life. Scores are not negative, so their
+// bits order them just like their values.
+unsigned long long orderKey( const charNode_t &node )
+{
+  if ( !halfLife )
+    return node.count.value();
+  const double score = decayedScore( node );
+  unsigned long long bits;
+  memcpy( &bits, &score, sizeof bits );
+  return bits;
+}
+
+void dump( const std::string &current, const std::string &prefix, const charNode_t *node,
+           countFormattingVisitor_c &visitor, charOrder_t &order );
+
+/*
+  How walkTrie() gets at the nodes of an extendedTrie_c. The visitor is told the node it enters for
+  its columns, and the children go through dump(). Children without strings are not shown.
+*/
+struct charWalker_t
+{
+  typedef std::string string_t;
+  typedef const charNode_t *handle_t;
+  typedef charNodes_t::const_iterator child_t;
+
+  countFormattingVisitor_c &visitor;
+
+  unsigned long long count( handle_t node ) const { return node->count.value(); }
+  handle_t node( child_t child ) const { return &child->second; }
+  char label( child_t child ) const { return child->first; }
+  bool byFrequency() const { return format.sortByFrequency(); }
+
+  bool onlyChild( handle_t node, child_t &child ) const
+  {
+    child = node->next.begin();
+    return node->next.size() == 1;
+  }
+
+  unsigned long long children( handle_t node, charOrder_t &order ) const
+  {
+    unsigned long long sum = 0;
+    for ( child_t it = node->next.begin(); it != node->next.end(); ++it )
+      if ( it->second.count.value() )
+      {
+        order.children.push_back( charOrder_t::entry_t( orderKey( it->second ), it ) );
+        sum += it->second.count.value();
+      }
+    return sum;
+  }
+
+  void enter( handle_t node, const std::string &current, const std::string &prefix, unsigned long long count,
+              unsigned long long terminal, std::size_t children )
+  {
+    visitor.node = node;
+    visitor.enter( current, prefix, count, terminal, children );
+  }
+  void leave( const std::string &current, const std::string &prefix ) { visitor.leave( current, prefix ); }
+
+  void descend( child_t child, const std::string &prefix, charOrder_t &order )
+  {
+    dump( std::string( 1, child->first ), prefix, &child->second, visitor, order );
+  }
+};
+
+/*
+  Show the trie below 'node' to 'visitor'. 'current' is the part of the string that the parent has
+  not shown, 'prefix' is the rest.
+*/
+void visitNode( const std::string &current, const std::string &prefix, const charNode_t *node,
+                countFormattingVisitor_c &visitor, charOrder_t &order )
+{
+  charWalker_t walker = { visitor };
+  walkTrie( walker, node, current, prefix, order );
+}
+
+/*
+  visitNode() for a child, unless its output is in the previous report of the renderCache and
+  still valid.
+*/
+void dump( const std::string &current, const std::string &prefix, const charNode_t *node,
+           countFormattingVisitor_c &visitor, charOrder_t &order )
+{
+  renderState_c *state = renderCache ? node->rendering() : 0;
+  if ( !state )
+  {
+    visitNode( current, prefix, node, visitor, order );
+    return;
+  }
+
+  visitor.separate();
+  renderCache->child( *state, [&]() {
+    visitor.alone( [&]() { visitNode( current, prefix, node, visitor, order ); } );
+  } );
+}
+
+void trieSink_c::report( std::ostream &out )
+{
+  // The window ends and the scores are taken now, unless the times come from the input
+  if ( !timeField )
+    newestTime = std::time( 0 );
+  if ( windowSeconds )
+  {
+    if ( !timeField )
+      newestBucket = windowBucket( newestTime );
+    expireWindow( _trie );
+  }
+
+  if ( distinctField )
+  {
+    distinctSketch_c all;
+    collectDistinct( _root, all );
+  }
+
+  if ( !_root.count.value() )
+    return;
+  countFormattingVisitor_c visitor( out );
+  charOrder_t order;
+  if ( renderCache )
+    renderCache->report( out, [&]() { visitNode( "", "", &_root, visitor, order ); } );
+  else
+    visitNode( "", "", &_root, visitor, order );
+}
+
+/*
+The same as visitNode(), for the nodes of the sketched depths only. The root is exact.
+*/
+void countMinEngine_c::write( std::ostream &out, charNode_t &node, std::size_t depth, std::string current,
+                             const std::string &prefix, bool isRootNode )
+{
+  if ( !node.count.value() )
+    return;
+  charNode_t *n = &node;
+  below_t children;
+  below( *n, depth, "", children );
+  while ( children.size() == 1 && children[ 0 ].second->count.value() == n->count.value() )
+  {
+    current += children[ 0 ].first;
+    depth += children[ 0 ].first.length();
+    n = children[ 0 ].second;
+    children.clear();
+    below( *n, depth, "", children );
+  }
+
+  unsigned long long nextCount = 0;
+  for ( std::size_t i = 0; i < children.size(); ++i )
+    nextCount += children[ i ].second->count.value();
+  if ( format.sortByFrequency() )
+    std::stable_sort( children.begin(), children.end(), byCount );
+
+  writeNodeHead( out, current, prefix, n->count.value(), 0, isRootNode, !children.empty(),
+                 nextCount < n->count.value(), isRootNode );
+  for ( std::size_t i = 0; i < children.size(); ++i )
+  {
+    if ( i )
+      writeNodeSeparator( out );
+    write( out, *children[ i ].second, depth + children[ i ].first.length(), children[ i ].first,
+           prefix + current, false );
+  }
+  writeNodeTail( out, current, isRootNode, !children.empty() );
+}
+
+void countMinEngine_c::report( std::ostream &out )
+{
+  extendedTrie_c approximate;
+  reconstruct( approximate.root() );
+  std::cerr << "stree: counts are too high by at most " << errorBound()
+            << " with a probability of 98%\n";
+  write( out, approximate.root(), 0, "", "", true );
+}
+
+/*
+  Engines that do not keep a trie of everything describe the nodes that visitNode() shows (the root,
+  strings and branching prefixes) as treeRecord_t's.
+*/
+struct treeRecord_t
+{
+  std::string label;            // the part of the string below the parent record
+  unsigned long long count;     // strings starting with the prefix
+  unsigned long long terminal;  // strings equal to the prefix
+  unsigned long long children;  // number of child records
+  unsigned long long below;     // bytes that the records of the descendants take in a spool
+};
+
+/*
+  treeWriter_c writes records given in preorder, with the children of each node in the order of
+  visitNode(), just like it would have written the corresponding trie.
+*/
+class treeWriter_c
+{
+  struct open_t
+  {
+    std::size_t prefixLength;
+    unsigned long long children, written;
+    std::string current;
+  };
+
+  countFormattingVisitor_c _visitor;
+  std::string _prefix;
+  std::vector< open_t > _open;
+  bool _first, _silent;
+
+  void closeFinished()
+  {
+    while ( !_open.empty() && _open.back().written == _open.back().children )
+    {
+      _prefix.resize( _open.back().prefixLength );
+      _visitor.leave( _open.back().current, _prefix );
+      _open.pop_back();
+    }
+  }
+
+public:
+  treeWriter_c( std::ostream &out ) : _visitor( out ), _first( true ), _silent( false ) {}
+
+  void add( const treeRecord_t &record )
+  {
+    if ( _first )
+    {
+      _first = false;
+      _silent = !record.count;
+      // Just like visitNode(), the root is merged with its only child, which becomes the root
+      if ( record.children == 1 && !record.terminal )
+        return;
+    }
+    if ( _silent )
+      return;
+
+    if ( !_open.empty() )
+      ++_open.back().written;
+    _visitor.enter( record.label, _prefix, record.count, record.terminal, record.children );
+    if ( record.children )
+    {
+      open_t open = { _prefix.length(), record.children, 0, record.label };
+      _open.push_back( open );
+      _prefix += record.label;
+    }
+    else
+    {
+      _visitor.leave( record.label, _prefix );
+      closeFinished();
+    }
+  }
+};
+
+/*
+  A recordSpool_c collects records in a temporary file and hands them to a treeWriter_c in reverse
+  order. Memory use does not depend on the number of records.
+*/
+class recordSpool_c
+{
+  FILE *_file;
+  std::string _encoded;
+  unsigned long long _size;
+
+  // Decode the record that ends at end, returns where it starts
+  static const char *decode( const char *end, treeRecord_t &record )
+  {
+    unsigned int length;
+    end -= sizeof length;
+    memcpy( &length, end, sizeof length );
+    const char *begin = end - length;
+    const char *label = readVarint( readVarint( readVarint( readVarint( begin, record.count ),
+                                                            record.terminal ),
+                                                record.children ),
+                                    record.below );
+    record.label.assign( label, end );
+    return begin;
+  }
+
+  /*
+    Replay the records that end at end in preorder, choosing the order of the children of each. They
+    precede their parent, the last one first, so they come in the order they were added. Records
+    added in byte order are put into trie order with byteOrder: trie order compares signed chars,
+    which puts the children that start with a byte of 0x80 or more first. With byCount, the
+    children are then ordered by count like visitNode() does.
+  */
+  static void replayOrdered( const char *end, treeWriter_c &writer, bool byteOrder, bool byCount )
+  {
+    typedef childOrder_t< const char* > order_t;
+    std::vector< const char* > pending( 1, end );
+    order_t order;
+    treeRecord_t record;
+    while ( !pending.empty() )
+    {
+      const char *p = decode( pending.back(), record );
+      pending.pop_back();
+      writer.add( record );
+
+      // Only the header and first byte of each child are needed to find the next one
+      order.children.clear();
+      std::size_t low = 0;
+      for ( unsigned long long i = 0; i < record.children; ++i )
+      {
+        unsigned int length;
+        memcpy( &length, p - sizeof length, sizeof length );
+        unsigned long long count, skipped, below;
+        const char *label = readVarint( readVarint( readVarint( readVarint( p - sizeof length - length,
+                                                                            count ),
+                                                                skipped ),
+                                                    skipped ),
+                                        below );
+        order.children.push_back( order_t::entry_t( count, p ) );
+        if ( !( static_cast< unsigned char >( *label ) & 0x80 ) )
+          ++low;
+        p -= sizeof length + length + below;
+      }
+      if ( byteOrder )
+        std::rotate( order.children.begin(), order.children.begin() + low, order.children.end() );
+      if ( byCount )
+        order.byKey( 0 );
+
+      // The stack takes the children in reverse
+      for ( std::size_t i = order.children.size(); i > 0; --i )
+        pending.push_back( order.children[ i - 1 ].second );
+    }
+  }
+
+public:
+  recordSpool_c() : _file( tmpfile() ), _size( 0 )
+  {
+    if ( !_file )
+    {
+      std::cerr << "stree: can not create a temporary file\n";
+      exit( 1 );
+    }
+  }
+  ~recordSpool_c() { fclose( _file ); }
+
+  void add( const treeRecord_t &record )
+  {
+    // The length comes last, so that the file can be read backwards
+    _encoded.clear();
+    writeVarint( _encoded, record.count );
+    writeVarint( _encoded, record.terminal );
+    writeVarint( _encoded, record.children );
+    writeVarint( _encoded, record.below );
+    _encoded += record.label;
+    const unsigned int length = _encoded.length();
+    _encoded.append( reinterpret_cast< const char* >( &length ), sizeof length );
+    fwrite( _encoded.data(), 1, _encoded.length(), _file );
+    _size += _encoded.length();
+  }
+
+  // Bytes written so far
+  unsigned long long size() const { return _size; }
+
+  /*
+    Hand the records to writer. Records added with the children in descending byte order rather than
+    trie order are put into trie order with byteOrder, and byCount orders children by their counts.
+  */
+  void replay( treeWriter_c &writer, bool byteOrder, bool byCount )
+  {
+    fflush( _file );
+    const off_t size = ftello( _file );
+    if ( !size )
+      return;
+    void *mapped = mmap( 0, size, PROT_READ, MAP_PRIVATE, fileno( _file ), 0 );
+    if ( mapped == MAP_FAILED )
+    {
+      std::cerr << "stree: can not map a temporary file\n";
+      exit( 1 );
+    }
+    const char *begin = static_cast< const char* >( mapped );
+    const char *p = begin + size;
+    treeRecord_t record;
+    if ( byteOrder || byCount )
+      replayOrdered( p, writer, byteOrder, byCount );
+    else
+      while ( p > begin )
+      {
+        p = decode( p, record );
+        writer.add( record );
+      }
+    munmap( mapped, size );
+  }
+};
+
+/*
+  lcpTreeBuilder_c turns strings given in descending order, each with its number of occurrences,
+  into the records of the tree they make up. Only the path to the latest string is kept, with a node
+  for each prefix that is a string or shared with an earlier one. Whenever a string has a shorter
+  prefix in common with its predecessor than that path, the deeper nodes are complete and are
+  handed to the spool, so the records come in postorder with the children in descending order,
+  which is preorder with ascending children read backwards.
+*/
+class lcpTreeBuilder_c
+{
+  struct open_t
+  {
+    std::size_t depth;
+    unsigned long long count, terminal, children;
+    unsigned long long start; // size of the spool before the first descendant
+  };
+
+  recordSpool_c &_spool;
+  std::vector< open_t > _open;
+  std::string _last;
+  bool _highBytes;
+
+  void close()
+  {
+    const open_t closed = _open.back();
+    _open.pop_back();
+    open_t &parent = _open.back();
+    treeRecord_t record;
+    record.label.assign( _last, parent.depth, closed.depth - parent.depth );
+    record.count = closed.count;
+    record.terminal = closed.terminal;
+    record.children = closed.children;
+    record.below = _spool.size() - closed.start;
+    _spool.add( record );
+    _highBytes |= static_cast< unsigned char >( record.label[ 0 ] ) >= 0x80;
+    parent.count += closed.count;
+    ++parent.children;
+  }
+
+public:
+  lcpTreeBuilder_c( recordSpool_c &spool ) : _spool( spool ), _highBytes( false )
+  {
+    const open_t root = { 0, 0, 0, 0, 0 };
+    _open.push_back( root );
+  }
+
+  void add( const char *s, std::size_t length, unsigned long long weight )
+  {
+    std::size_t common = 0;
+    while ( common < length && common < _last.length() && s[ common ] == _last[ common ] )
+      ++common;
+
+    while ( _open.back().depth > common )
+    {
+      if ( _open[ _open.size() - 2 ].depth < common )
+      {
+        // The new string branches off in the middle of the latest edge
+        const open_t branch = { common, 0, 0, 0, _open.back().start };
+        _open.insert( _open.end() - 1, branch );
+      }
+      close();
+    }
+
+    _last.assign( s, length );
+    if ( length > common )
+    {
+      const open_t leaf = { length, weight, weight, 0, _spool.size() };
+      _open.push_back( leaf );
+    }
+    else
+    {
+      _open.back().count += weight;
+      _open.back().terminal += weight;
+    }
+  }
+
+  // Whether a record starts with a byte of 0x80 or more, where byte and trie order differ
+  bool highBytes() const { return _highBytes; }
+
+  // Close all nodes, the root comes last
+  void finish()
+  {
+    while ( _open.size() > 1 )
+      close();
+    treeRecord_t root;
+    root.count = _open.back().count;
+    root.terminal = _open.back().terminal;
+    root.children = _open.back().children;
+    root.below = _spool.size();
+    _spool.add( root );
+  }
+};
+
+/*
+  Strings are compared the way std::map< char, ... > orders them, i.e. by (signed) char.
+*/
+bool trieLess( const char *lhs, std::size_t lhsLength, const char *rhs, std::size_t rhsLength )
+{
+  return std::lexicographical_compare( lhs, lhs + lhsLength, rhs, rhs + rhsLength );
+}
+
+bool trieLess( const std::string &lhs, const std::string &rhs )
+{
+  return trieLess( lhs.data(), lhs.length(), rhs.data(), rhs.length() );
+}
+
+/*
+  Strings compared by unsigned bytes, the order of LC_ALL=C sort.
+*/
+bool byteLess( const char *lhs, std::size_t lhsLength, const char *rhs, std::size_t rhsLength )
+{
+  const int order = memcmp( lhs, rhs, std::min( lhsLength, rhsLength ) );
+  return order < 0 || ( order == 0 && lhsLength < rhsLength );
+}
+
+/*
+  A run is a temporary file of strings in descending order with their number of occurrences. Each
+  string is stored as the length of the prefix it shares with its predecessor and the rest.
+*/
+class runWriter_c
+{
+  FILE *_file;
+  std::string _last, _encoded;
+
+public:
+  runWriter_c( FILE *file ) : _file( file ) {}
+
+  void add( const std::string &s, unsigned long long weight )
+  {
+    std::size_t common = 0;
+    while ( common < s.length() && common < _last.length() && s[ common ] == _last[ common ] )
+      ++common;
+    _encoded.clear();
+    writeVarint( _encoded, common );
+    writeVarint( _encoded, s.length() - common );
+    _encoded.append( s, common, std::string::npos );
+    writeVarint( _encoded, weight );
+    fwrite( _encoded.data(), 1, _encoded.length(), _file );
+    _last = s;
+  }
+};
+
+class runReader_c
+{
+  FILE *_file;
+
+  bool readVarint( unsigned long long &value )
+  {
+    value = 0;
+    for ( int shift = 0; shift < 64; shift += 7 )
+    {
+      const int c = getc( _file );
+      if ( c == EOF )
+        return false;
+      value |= static_cast< unsigned long long >( c & 0x7f ) << shift;
+      if ( !( c & 0x80 ) )
+        return true;
+    }
+    return false;
+  }
+
+public:
+  std::string current;
+  unsigned long long weight;
+
+  runReader_c( FILE *file ) : _file( file ), weight( 0 ) { rewind( _file ); }
+
+  bool next()
+  {
+    unsigned long long common, rest;
+    if ( !readVarint( common ) || !readVarint( rest ) )
+      return false;
+    current.resize( common + rest );
+    if ( rest && fread( &current[ common ], 1, rest, _file ) != rest )
+      return false;
+    return readVarint( weight );
+  }
+};
+
+/*
+  Write the strings of the trie below 'root' in descending order: for each node the children, last
+  one first, and then the strings ending at the node. The nodes on the way are kept on a stack of
+  their own rather than by recursion, as there may be as many as a string is long.
+*/
+void writeRun( const charNode_t &root, runWriter_c &run )
+{
+  struct open_t
+  {
+    const charNode_t *node;
+    charNodes_t::const_reverse_iterator next; // the child to write next
+    unsigned long long terminal;              // count less that of the children written
+  };
+  std::string path;
+  const open_t first = { &root, root.next.rbegin(), root.count.value() };
+  std::vector< open_t > open( 1, first );
+  while ( !open.empty() )
+  {
+    open_t &last = open.back();
+    if ( last.next != last.node->next.rend() )
+    {
+      const charNode_t &child = last.next->second;
+      last.terminal -= child.count.value();
+      path += last.next->first;
+      ++last.next;
+      const open_t below = { &child, child.next.rbegin(), child.count.value() };
+      open.push_back( below );
+      continue;
+    }
+    if ( last.terminal )
+      run.add( path, last.terminal );
+    open.pop_back();
+    if ( !open.empty() )
+      path.erase( path.length() - 1 );
+  }
+}
+
+struct radixLine_t
+{
+  const char *s;
+  std::size_t length;
+};
+
+/*
+  With --radix-sort, strings are just appended to one buffer. The report sorts them with a most
+  significant digit radix sort: the strings below a prefix are one range of the array, which is
+  split by the character after the prefix. Every node of the trie is visited this way with the
+  number of its strings being the size of its range, so the tree is written right from the
+  recursion without a single trie node.
+
+  The character at the current depth of each string is read once into _digits, so the counting
+  and the distribution do not chase the string pointers again. Small ranges are sorted by
+  insertion instead, which avoids the histogram of 257 digits, and ranges whose strings all
+  continue the same way are not moved at all.
+*/
+class radixSortEngine_c : public lineSink_c
+{
+protected:
+  struct bucket_t
+  {
+    radixLine_t *begin, *end;
+    char c;
+  };
+
+  static bool bySize( const bucket_t &lhs, const bucket_t &rhs )
+  {
+    return lhs.end - lhs.begin > rhs.end - rhs.begin;
+  }
+
+  std::string _text;
+  std::vector< std::size_t > _ends;
+
+  void collect( std::vector< radixLine_t > &lines )
+  {
+    lines.resize( _ends.size() );
+    for ( std::size_t i = 0, begin = 0; i < _ends.size(); begin = _ends[ i++ ] )
+    {
+      lines[ i ].s = _text.data() + begin;
+      lines[ i ].length = _ends[ i ] - begin;
+    }
+  }
+
+private:
+  std::vector< radixLine_t > _scratch;
+  // 0 for strings ending at the current depth, otherwise 1 + the (unsigned) character
+  std::vector< unsigned short > _digits, _scratchDigits;
+
+  unsigned short digit( const radixLine_t &line, std::size_t depth )
+  {
+    return depth < line.length ? 1 + static_cast< unsigned char >( line.s[ depth ] ) : 0;
+  }
+
+  /*
+    Sort the range by the character at 'depth' and return the number of strings ending there.
+    The other ones are grouped into 'children', in the order of the trie.
+  */
+  std::size_t split( radixLine_t *begin, radixLine_t *end, std::size_t depth,
+                     std::vector< bucket_t > &children )
+  {
+    const std::size_t n = end - begin;
+    unsigned short *digits = &_digits[ 0 ];
+    bool same = true;
+    for ( std::size_t i = 0; i < n; ++i )
+    {
+      digits[ i ] = digit( begin[ i ], depth );
+      same = same && digits[ i ] == digits[ 0 ];
+    }
+
+    if ( same )
+      ;
+    else if ( n < 32 )
+    {
+      for ( std::size_t i = 1; i < n; ++i )
+      {
+        const radixLine_t line = begin[ i ];
+        const unsigned short d = digits[ i ];
+        std::size_t j = i;
+        for ( ; j > 0 && digits[ j - 1 ] > d; --j )
+        {
+          begin[ j ] = begin[ j - 1 ];
+          digits[ j ] = digits[ j - 1 ];
+        }
+        begin[ j ] = line;
+        digits[ j ] = d;
+      }
+    }
+    else
+    {
+      std::size_t offsets[ 258 ] = { 0 };
+      for ( std::size_t i = 0; i < n; ++i )
+        ++offsets[ digits[ i ] + 1 ];
+      for ( int d = 1; d < 258; ++d )
+        offsets[ d ] += offsets[ d - 1 ];
+      for ( std::size_t i = 0; i < n; ++i )
+      {
+        const std::size_t to = offsets[ digits[ i ] ]++;
+        _scratch[ to ] = begin[ i ];
+        _scratchDigits[ to ] = digits[ i ];
+      }
+      std::copy( _scratch.begin(), _scratch.begin() + n, begin );
+      std::copy( _scratchDigits.begin(), _scratchDigits.begin() + n, digits );
+    }
+
+    std::size_t terminal = 0;
+    while ( terminal < n && !digits[ terminal ] )
+      ++terminal;
+    children.clear();
+    for ( std::size_t i = terminal; i < n; )
+    {
+      std::size_t j = i + 1;
+      while ( j < n && digits[ j ] == digits[ i ] )
+        ++j;
+      const bucket_t bucket = { begin + i, begin + j, static_cast< char >( digits[ i ] - 1 ) };
+      children.push_back( bucket );
+      i = j;
+    }
+    // The trie orders by char, which puts the upper half of the bytes first
+    std::size_t low = 0;
+    while ( low < children.size() && children[ low ].c >= 0 )
+      ++low;
+    std::rotate( children.begin(), children.begin() + low, children.end() );
+    return terminal;
+  }
+
+  void emit( std::ostream &out, radixLine_t *begin, radixLine_t *end, std::size_t depth,
+             std::string current, const std::string &prefix, bool isRootNode )
+  {
+    std::vector< bucket_t > children;
+    std::size_t terminal;
+    // Prefixes with just one non-optional continuation are written on one line, like visitNode()
+    while ( true )
+    {
+      if ( end - begin == 1 )
+      {
+        current.append( begin->s + depth, begin->length - depth );
+        terminal = 1;
+        break;
+      }
+      terminal = split( begin, end, depth, children );
+      if ( terminal || children.size() != 1 )
+        break;
+      current += children[ 0 ].c;
+      ++depth;
+    }
+
+    if ( format.sortByFrequency() )
+      std::stable_sort( children.begin(), children.end(), bySize );
+
+    writeNodeHead( out, current, prefix, end - begin, 0, isRootNode, !children.empty(), terminal > 0 );
+    for ( std::size_t i = 0; i < children.size(); ++i )
+    {
+      if ( i )
+        writeNodeSeparator( out );
+      emit( out, children[ i ].begin, children[ i ].end, depth + 1,
+            std::string( 1, children[ i ].c ), prefix + current, false );
+    }
+    writeNodeTail( out, current, isRootNode, !children.empty() );
+  }
+
+public:
+  void add( std::string &s )
+  {
+    _text += s;
+    _ends.push_back( _text.length() );
+  }
+
+  void report( std::ostream &out )
+  {
+    if ( _ends.empty() )
+      return;
+    std::vector< radixLine_t > lines;
+    collect( lines );
+    _scratch.resize( lines.size() );
+    _digits.resize( lines.size() );
+    _scratchDigits.resize( lines.size() );
+    emit( out, &lines[ 0 ], &lines[ 0 ] + lines.size(), 0, "", "", true );
+  }
+};
+
+// The order of the trie, which compares (signed) chars
+inline bool lineLess( const radixLine_t &lhs, const radixLine_t &rhs )
+{
+  const std::size_t common = commonPrefix( lhs.s, lhs.length, rhs.s, rhs.length );
+  if ( common == rhs.length )
+    return false;
+  return common == lhs.length || lhs.s[ common ] < rhs.s[ common ];
+}
+
+/*
+  Run work( part ) for each part in [0, parts) on a thread of its own.
+*/
+template< typename work_t >
+void inParallel( unsigned int parts, work_t work )
+{
+  std::vector< std::thread > workers;
+  for ( unsigned int part = 1; part < parts; ++part )
+    workers.push_back( std::thread( work, part ) );
+  work( 0 );
+  for ( std::size_t i = 0; i < workers.size(); ++i )
+    workers[ i ].join();
+}
+
+/*
+  --radix-sort with --threads. A sample of the strings gives threads - 1 splitters, which divide
+  them into as many buckets. Each thread classifies a slice of the strings, then the slices are
+  scattered to their buckets, each bucket is sorted, and the common prefix of each string with its
+  predecessor is computed, all in parallel without any shared mutable state besides disjoint parts
+  of the arrays.
+
+  Writing the tree is sequential but does not look at the strings beyond their common prefixes: a
+  node is a range of the sorted array, its prefix is as long as the smallest common prefix within
+  the range, and its children start where the common prefix is exactly that long.
+*/
+class parallelSortEngine_c : public radixSortEngine_c
+{
+  std::vector< radixLine_t > _lines;
+  std::vector< std::size_t > _common;
+
+  void sort()
+  {
+    const std::size_t n = _lines.size();
+    std::vector< radixLine_t > sample;
+    for ( std::size_t i = 0; i < threads * 16; ++i )
+      sample.push_back( _lines[ i * n / ( threads * 16 ) ] );
+    std::sort( sample.begin(), sample.end(), lineLess );
+    std::vector< radixLine_t > splitters;
+    for ( unsigned int i = 1; i < threads; ++i )
+      splitters.push_back( sample[ i * 16 ] );
+
+    // Classify, then find where each thread's strings of each bucket go
+    std::vector< unsigned int > buckets( n );
+    std::vector< std::vector< std::size_t > > counts( threads, std::vector< std::size_t >( threads, 0 ) );
+    inParallel( threads, [&]( unsigned int part )
+    {
+      for ( std::size_t i = part * n / threads; i < ( part + 1 ) * n / threads; ++i )
+      {
+        buckets[ i ] = std::upper_bound( splitters.begin(), splitters.end(), _lines[ i ], lineLess ) -
+                       splitters.begin();
+        ++counts[ part ][ buckets[ i ] ];
+      }
+    } );
+    std::vector< std::size_t > bucketBegin( threads + 1, 0 );
+    std::vector< std::vector< std::size_t > > offsets( threads, std::vector< std::size_t >( threads ) );
+    std::size_t offset = 0;
+    for ( unsigned int bucket = 0; bucket < threads; ++bucket )
+    {
+      bucketBegin[ bucket ] = offset;
+      for ( unsigned int part = 0; part < threads; ++part )
+      {
+        offsets[ part ][ bucket ] = offset;
+        offset += counts[ part ][ bucket ];
+      }
+    }
+    bucketBegin[ threads ] = n;
+
+    std::vector< radixLine_t > sorted( n );
+    inParallel( threads, [&]( unsigned int part )
+    {
+      for ( std::size_t i = part * n / threads; i < ( part + 1 ) * n / threads; ++i )
+        sorted[ offsets[ part ][ buckets[ i ] ]++ ] = _lines[ i ];
+    } );
+    inParallel( threads, [&]( unsigned int bucket )
+    {
+      std::sort( sorted.begin() + bucketBegin[ bucket ], sorted.begin() + bucketBegin[ bucket + 1 ],
+                 lineLess );
+    } );
+    _lines.swap( sorted );
+
+    _common.assign( n, 0 );
+    inParallel( threads, [&]( unsigned int part )
+    {
+      for ( std::size_t i = std::max< std::size_t >( 1, part * n / threads ); i < ( part + 1 ) * n / threads; ++i )
+        _common[ i ] = commonPrefix( _lines[ i - 1 ].s, _lines[ i - 1 ].length, _lines[ i ].s, _lines[ i ].length );
+    } );
+  }
+
+  void emit( std::ostream &out, std::size_t begin, std::size_t end, std::size_t depth,
+             std::string current, const std::string &prefix, bool isRootNode )
+  {
+    std::size_t terminal = 0;
+    std::vector< bucket_t > children;
+    if ( end - begin == 1 )
+    {
+      current.append( _lines[ begin ].s + depth, _lines[ begin ].length - depth );
+      terminal = 1;
+    }
+    else
+    {
+      // Prefixes with just one non-optional continuation are written on one line
+      const std::size_t common = *std::min_element( &_common[ begin + 1 ], &_common[ 0 ] + end );
+      current.append( _lines[ begin ].s + depth, common - depth );
+      depth = common;
+      while ( begin + terminal < end && _lines[ begin + terminal ].length == depth )
+        ++terminal;
+      for ( std::size_t i = begin + terminal; i < end; )
+      {
+        std::size_t j = i + 1;
+        while ( j < end && _common[ j ] > depth )
+          ++j;
+        const bucket_t bucket = { &_lines[ 0 ] + i, &_lines[ 0 ] + j, _lines[ i ].s[ depth ] };
+        children.push_back( bucket );
+        i = j;
+      }
+      if ( format.sortByFrequency() )
+        std::stable_sort( children.begin(), children.end(), bySize );
+    }
+
+    writeNodeHead( out, current, prefix, end - begin, 0, isRootNode, !children.empty(), terminal > 0 );
+    for ( std::size_t i = 0; i < children.size(); ++i )
+    {
+      if ( i )
+        writeNodeSeparator( out );
+      emit( out, children[ i ].begin - &_lines[ 0 ], children[ i ].end - &_lines[ 0 ], depth + 1,
+            std::string( 1, children[ i ].c ), prefix + current, false );
+    }
+    writeNodeTail( out, current, isRootNode, !children.empty() );
+  }
+
+public:
+  void report( std::ostream &out )
+  {
+    if ( _ends.empty() )
+      return;
+    collect( _lines );
+    sort();
+    emit( out, 0, _lines.size(), 0, "", "", true );
+  }
+};
+
+/*
+  A trie node that any number of threads may enter strings into at the same time. The children are
+  a list sorted by character, which only ever grows: a new child is linked in with a
+  compare-and-swap of the link in front of it, and if another thread changed that link meanwhile,
+  the search continues from there. Counts are only read once all threads are done, so they are
+  incremented without any ordering.
+
+  Each worker takes the nodes it creates from an arena of its own, so that they end up in memory
+  local to it with --numa local. Nodes are never freed.
+*/
+class concurrentNode_c
+{
+  std::atomic< unsigned long long > _count;
+  std::atomic< concurrentNode_c* > _first, _sibling;
+  const char _c;
+
+  concurrentNode_c( const concurrentNode_c& );
+  concurrentNode_c &operator=( const concurrentNode_c& );
+
+public:
+  concurrentNode_c( char c = 0 ) : _count( 0 ), _first( 0 ), _sibling( 0 ), _c( c ) {}
+
+  char c() const { return _c; }
+  unsigned long long count() const { return _count.load( std::memory_order_relaxed ); }
+  const concurrentNode_c *first() const { return _first.load( std::memory_order_acquire ); }
+  const concurrentNode_c *sibling() const { return _sibling.load( std::memory_order_acquire ); }
+
+  void add() { _count.fetch_add( 1, std::memory_order_relaxed ); }
+
+  concurrentNode_c *child( char c, std::pmr::memory_resource &arena )
+  {
+    concurrentNode_c *created = 0;
+    std::atomic< concurrentNode_c* > *link = &_first;
+    while ( true )
+    {
+      concurrentNode_c *next = link->load( std::memory_order_acquire );
+      while ( next && next->_c < c )
+      {
+        link = &next->_sibling;
+        next = link->load( std::memory_order_acquire );
+      }
+      if ( next && next->_c == c )
+        return next; // another thread may have been faster, then 'created' is left unused
+      if ( !created )
+        created = new ( arena.allocate( sizeof( concurrentNode_c ), alignof( concurrentNode_c ) ) )
+          concurrentNode_c( c );
+      created->_sibling.store( next, std::memory_order_relaxed );
+      if ( link->compare_exchange_weak( next, created, std::memory_order_release,
+                                        std::memory_order_relaxed ) )
+        return created;
+    }
+  }
+};
+
+typedef childOrder_t< const concurrentNode_c* > concurrentOrder_t;
+
+/*
+  How walkTrie() gets at the nodes of a concurrentNode_c trie.
+*/
+struct concurrentWalker_t
+{
+  typedef std::string string_t;
+  typedef const concurrentNode_c *handle_t;
+  typedef const concurrentNode_c *child_t;
+
+  countFormattingVisitor_c &visitor;
+
+  unsigned long long count( handle_t node ) const { return node->count(); }
+  handle_t node( child_t child ) const { return child; }
+  char label( child_t child ) const { return child->c(); }
+  bool byFrequency() const { return format.sortByFrequency(); }
+
+  bool onlyChild( handle_t node, child_t &child ) const
+  {
+    child = node->first();
+    return child && !child->sibling();
+  }
+
+  unsigned long long children( handle_t node, concurrentOrder_t &order ) const
+  {
+    unsigned long long sum = 0;
+    for ( child_t child = node->first(); child; child = child->sibling() )
+    {
+      order.children.push_back( concurrentOrder_t::entry_t( child->count(), child ) );
+      sum += child->count();
+    }
+    return sum;
+  }
+
+  void enter( handle_t, const std::string &current, const std::string &prefix, unsigned long long count,
+              unsigned long long terminal, std::size_t children )
+  {
+    visitor.enter( current, prefix, count, terminal, children );
+  }
+  void leave( const std::string &current, const std::string &prefix ) { visitor.leave( current, prefix ); }
+
+  void descend( child_t child, const std::string &prefix, concurrentOrder_t &order )
+  {
+    walkTrie( *this, child, std::string( 1, child->c() ), prefix, order );
+  }
+};
+
+/*
+  With --threads, but without --radix-sort. addFrom() may be called from all workers at once, which
+  keep their arenas from one file to the next.
+*/
+class concurrentTrieSink_c : public lineSink_c
+{
+  concurrentNode_c _root;
+  std::vector< std::pmr::memory_resource* > _arenas;
+
+public:
+  concurrentTrieSink_c()
+  {
+    for ( unsigned int worker = 0; worker < threads; ++worker )
+      _arenas.push_back( new std::pmr::monotonic_buffer_resource( chunkResource_c::bufferSize, &chunks ) );
+  }
+
+  void add( std::string &s ) { addFrom( s, 0 ); }
+
+  void addFrom( std::string &s, unsigned int worker )
+  {
+    concurrentNode_c *current = &_root;
+    current->add();
+    for ( std::size_t i = 0; i < s.length(); ++i )
+    {
+      current = current->child( s[ i ], *_arenas[ worker ] );
+      current->add();
+    }
+  }
+
+  void report( std::ostream &out )
+  {
+    if ( !_root.count() )
+      return;
+    countFormattingVisitor_c visitor( out );
+    concurrentOrder_t order;
+    concurrentWalker_t walker = { visitor };
+    walkTrie( walker, &_root, "", "", order );
+  }
+};
+
+/*
+  A regular file mapped into memory, for engines that read their input more than once. 'advice' is
+  given to madvise() and tells the kernel how the file is going to be read.
+*/
+class mappedFile_c
+{
+  void *_mapped;
+  std::size_t _size;
+
+  mappedFile_c( const mappedFile_c& );
+  mappedFile_c &operator=( const mappedFile_c& );
+
+public:
+  const char *begin, *end;
+
+  mappedFile_c( const std::string &path, int advice = MADV_SEQUENTIAL )
+    : _mapped( MAP_FAILED ), _size( 0 ), begin( "" ), end( begin )
+  {
+    const int fd = open( path.c_str(), O_RDONLY );
+    struct stat st;
+    if ( fd < 0 || fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) )
+    {
+      std::cerr << "stree: can not map " << path << "\n";
+      exit( 1 );
+    }
+    _size = st.st_size;
+    if ( _size )
+    {
+      _mapped = mmap( 0, _size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      if ( _mapped == MAP_FAILED )
+      {
+        std::cerr << "stree: can not map " << path << "\n";
+        exit( 1 );
+      }
+      madvise( _mapped, _size, advice );
+      begin = static_cast< const char* >( _mapped );
+      end = begin + _size;
+    }
+    close( fd );
+  }
+  ~mappedFile_c()
+  {
+    if ( _mapped != MAP_FAILED )
+      munmap( _mapped, _size );
+  }
+
+  // The end of the line starting at 'p'
+  const char *lineEnd( const char *p ) const
+  {
+    const char *newline = static_cast< const char* >( memchr( p, '\n', end - p ) );
+    return newline ? newline : end;
+  }
+};
+
+/*
+  Split each file into one part per thread, at line boundaries, and feed them to 'sink' at the same
+  time. Files that can not be mapped are read by one thread.
+*/
+void readInParallel( lineSink_c &sink, sampler_c &sampler )
+{
+  for ( std::size_t file = 0; file < inputPositions.size(); ++file )
+  {
+    struct stat st;
+    if ( stat( inputPositions[ file ].path.c_str(), &st ) != 0 || !S_ISREG( st.st_mode ) )
+    {
+      readFile( inputPositions[ file ], sink, sampler );
+      continue;
+    }
+    const mappedFile_c mapped( inputPositions[ file ].path );
+    std::vector< const char* > parts( threads + 1, mapped.end );
+    parts[ 0 ] = mapped.begin;
+    for ( unsigned int part = 1; part < threads; ++part )
+    {
+      // A part starts with the first line that starts in it
+      const char *p = std::max( parts[ part - 1 ], mapped.begin + ( mapped.end - mapped.begin ) * part / threads );
+      parts[ part ] = p == mapped.begin ? p : std::min( mapped.lineEnd( p - 1 ) + 1, mapped.end );
+    }
+    inParallel( threads, [&]( unsigned int part )
+    {
+      std::string s;
+      for ( const char *p = parts[ part ]; p < parts[ part + 1 ]; )
+      {
+        const char *lineEnd = mapped.lineEnd( p );
+        s.assign( p, lineEnd );
+        sink.addFrom( s, part );
+        p = lineEnd + 1;
+      }
+    } );
+  }
+}
+
+bool byFirstDescending( const std::pair< unsigned long long, char > &lhs,
+                        const std::pair< unsigned long long, char > &rhs )
+{
+  return lhs.first > rhs.first;
+}
+
+/*
+  With --partitioned, the root's children are built one at a time. The first pass only counts the
+  strings by their first character, which is all that is needed to write the root and to order its
+  children. Then, for each of them, the files are read again and only the strings starting with
+  that character are entered into a fresh trie, which is written and thrown away.
+*/
+void reportPartitioned( std::ostream &out )
+{
+  std::vector< mappedFile_c* > files;
+  for ( std::size_t i = 0; i < inputPositions.size(); ++i )
+    files.push_back( new mappedFile_c( inputPositions[ i ].path ) );
+
+  unsigned long long strings = 0, empty = 0;
+  std::vector< unsigned long long > histogram( 256, 0 );
+  for ( std::size_t i = 0; i < files.size(); ++i )
+    for ( const char *p = files[ i ]->begin; p < files[ i ]->end; p = files[ i ]->lineEnd( p ) + 1 )
+    {
+      ++strings;
+      if ( *p == '\n' )
+        ++empty;
+      else
+        ++histogram[ static_cast< unsigned char >( *p ) ];
+    }
+
+  // Children in the order visitNode() would write them
+  std::vector< std::pair< unsigned long long, char > > partitions;
+  for ( int c = std::numeric_limits< char >::min(); c <= std::numeric_limits< char >::max(); ++c )
+    if ( histogram[ static_cast< unsigned char >( c ) ] )
+      partitions.push_back( std::make_pair( histogram[ static_cast< unsigned char >( c ) ],
+                                            static_cast< char >( c ) ) );
+  if ( format.sortByFrequency() )
+    std::stable_sort( partitions.begin(), partitions.end(), byFirstDescending );
+
+  // A root with just one child is merged with it, which the trie of that child takes care of
+  const bool merged = partitions.size() == 1 && !empty;
+  countFormattingVisitor_c visitor( out );
+  charOrder_t order;
+  if ( strings && !merged )
+    visitor.enter( "", "", strings, empty, partitions.size() );
+
+  std::string s;
+  for ( std::size_t part = 0; part < partitions.size(); ++part )
+  {
+    const char first = partitions[ part ].second;
+    extendedTrie_c partition;
+    trieSink_c sink( partition );
+    for ( std::size_t i = 0; i < files.size(); ++i )
+      for ( const char *p = files[ i ]->begin; p < files[ i ]->end; )
+      {
+        const char *lineEnd = files[ i ]->lineEnd( p );
+        if ( *p == first && p < lineEnd )
+        {
+          s.assign( p, lineEnd );
+          sink.add( s );
+        }
+        p = lineEnd + 1;
+      }
+
+    if ( merged )
+      visitNode( "", "", &partition.root(), visitor, order );
+    else
+      visitNode( std::string( 1, first ), "", &partition.root().next.begin()->second, visitor, order );
+  }
+
+  if ( strings && !merged )
+    visitor.leave( "", "" );
+
+  for ( std::size_t i = 0; i < files.size(); ++i )
+    delete files[ i ];
+}
+
+/*
+  The strings of a sorted file, last one first. They are not copied, but point into the mapping,
+  which is read backwards, so the kernel is not told to expect sequential reads: it would drop the
+  pages right before those that are read next.
+*/
+class sortedFile_c
+{
+  const std::string _path;
+  mappedFile_c _file;
+  const char *_limit;
+  bool _done;
+
+public:
+  const char *line;
+  std::size_t length;
+
+  sortedFile_c( const std::string &path )
+    : _path( path ), _file( path, MADV_NORMAL ), _limit( _file.end ), _done( _file.begin == _file.end ),
+      line( 0 ), length( 0 )
+  {
+    // The last newline does not start another string
+    if ( _limit > _file.begin && _limit[ -1 ] == '\n' )
+      --_limit;
+  }
+
+  bool previous()
+  {
+    if ( _done )
+      return false;
+    const char *newline = static_cast< const char* >( memrchr( _file.begin, '\n', _limit - _file.begin ) );
+    const char *next = line;
+    const std::size_t nextLength = length;
+    line = newline ? newline + 1 : _file.begin;
+    length = _limit - line;
+    if ( newline )
+      _limit = newline;
+    else
+      _done = true;
+
+    if ( next && byteLess( next, nextLength, line, length ) )
+    {
+      std::cerr << "stree: " << _path << " is not sorted\n";
+      exit( 1 );
+    }
+    return true;
+  }
+};
+
+struct byLine
+{
+  bool operator()( const sortedFile_c *lhs, const sortedFile_c *rhs ) const
+  {
+    return byteLess( lhs->line, lhs->length, rhs->line, rhs->length );
+  }
+};
+
+/*
+  With --merge-sorted, the files are merged from their ends, so that the strings come in descending
+  order, which is what lcpTreeBuilder_c needs. The files are sorted by unsigned bytes, which only
+  differs from trie order in where the bytes of 0x80 and more go, so the spool is replayed in trie
+  order, or by frequency with -f or -F.
+*/
+void reportMerged( std::ostream &out )
+{
+  std::vector< sortedFile_c* > files;
+  std::priority_queue< sortedFile_c*, std::vector< sortedFile_c* >, byLine > heap;
+  for ( std::size_t i = 0; i < inputPositions.size(); ++i )
+  {
+    files.push_back( new sortedFile_c( inputPositions[ i ].path ) );
+    if ( files.back()->previous() )
+      heap.push( files.back() );
+  }
+
+  recordSpool_c spool;
+  lcpTreeBuilder_c builder( spool );
+  while ( !heap.empty() )
+  {
+    sortedFile_c *file = heap.top();
+    heap.pop();
+    builder.add( file->line, file->length, 1 );
+    if ( file->previous() )
+      heap.push( file );
+  }
+  builder.finish();
+
+  treeWriter_c writer( out );
+  spool.replay( writer, builder.highBytes(), format.sortByFrequency() );
+
+  for ( std::size_t i = 0; i < files.size(); ++i )
+    delete files[ i ];
+}
+
+/*
+  With --memory-limit, the trie is written to a run and emptied whenever it becomes too large. The
+  report merges all runs, which needs memory for one string per run only.
+*/
+class spillingSink_c : public trieSink_c
+{
+  std::vector< FILE* > _runs;
+
+  void spill()
+  {
+    FILE *file = tmpfile();
+    if ( !file )
+    {
+      std::cerr << "stree: can not create a temporary file\n";
+      exit( 1 );
+    }
+    runWriter_c run( file );
+    writeRun( _root, run );
+    fflush( file );
+    _runs.push_back( file );
+    _trie.removeChildren( _root );
+    _root.count.set( 0 );
+  }
+
+  struct byString
+  {
+    bool operator()( const runReader_c *lhs, const runReader_c *rhs ) const
+    {
+      return trieLess( lhs->current, rhs->current );
+    }
+  };
+
+public:
+  spillingSink_c( extendedTrie_c &trie ) : trieSink_c( trie ) {}
+  ~spillingSink_c()
+  {
+    for ( std::size_t i = 0; i < _runs.size(); ++i )
+      fclose( _runs[ i ] );
+  }
+
+  void add( std::string &line )
+  {
+    trieSink_c::add( line );
+    if ( trieBytes() > memoryLimit )
+      spill();
+  }
+
+  void report( std::ostream &out )
+  {
+    if ( _root.count.value() )
+      spill();
+
+    // Merge the runs, largest string first
+    std::vector< runReader_c* > readers;
+    std::priority_queue< runReader_c*, std::vector< runReader_c* >, byString > heap;
+    for ( std::size_t i = 0; i < _runs.size(); ++i )
+    {
+      readers.push_back( new runReader_c( _runs[ i ] ) );
+      if ( readers.back()->next() )
+        heap.push( readers.back() );
+    }
+
+    recordSpool_c spool;
+    lcpTreeBuilder_c builder( spool );
+    while ( !heap.empty() )
+    {
+      runReader_c *reader = heap.top();
+      heap.pop();
+      builder.add( reader->current.data(), reader->current.length(), reader->weight );
+      if ( reader->next() )
+        heap.push( reader );
+    }
+    builder.finish();
+    for ( std::size_t i = 0; i < readers.size(); ++i )
+      delete readers[ i ];
+
+    treeWriter_c writer( out );
+    spool.replay( writer, false, format.sortByFrequency() );
+  }
+};
+
+double monotonicSeconds()
+{
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+  Whether data or the end of a pipe is waiting on fd, so that reading it will not block.
+*/
+bool readable( int fd )
+{
+  struct pollfd ready;
+  ready.fd = fd;
+  ready.events = POLLIN;
+  return poll( &ready, 1, 0 ) > 0;
+}
+
+/*
+  Keep reading the inputs as they grow and report every followInterval seconds. Growing files are
+  noticed through inotify, stdin is polled and left blocking. Returns once stdin ends, files are
+  followed forever. A file that is moved away or deleted, as by log rotation, is read to its end
+  and then opened again by name as soon as it exists again.
+*/
+void follow( lineSink_c &sink, sampler_c &sampler )
+{
+  struct input_t
+  {
+    int fd;
+    int watch;
+    bool replaced; // moved or deleted, to be reopened by name
+    int successor; // the file now under the name, once it exists
+    inputPosition_t *position;
+    std::string pending; // incomplete last line
+  };
+  std::vector< input_t > inputs;
+
+  const int notify = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+  const uint32_t watched = IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF;
+  for ( std::size_t i = 0; i < inputPositions.size(); ++i )
+  {
+    input_t input;
+    input.position = &inputPositions[ i ];
+    input.fd = open( input.position->path.c_str(), O_RDONLY );
+    if ( input.fd < 0 )
+    {
+      std::cerr << "stree: can not read " << input.position->path << "\n";
+      continue;
+    }
+    lseek( input.fd, input.position->offset, SEEK_SET );
+    input.watch = inotify_add_watch( notify, input.position->path.c_str(), watched );
+    input.replaced = false;
+    input.successor = -1;
+    inputs.push_back( input );
+  }
+  const bool fromStdin = inputPositions.empty();
+  if ( fromStdin )
+  {
+    input_t input;
+    input.fd = 0;
+    input.watch = -1;
+    input.replaced = false;
+    input.successor = -1;
+    input.position = 0;
+    inputs.push_back( input );
+  }
+
+  if ( nodeExtra_c::renders() )
+    renderCache = new renderCache_c;
+
+  unsigned long long skip = sampler.skip();
+  double next = monotonicSeconds() + followInterval;
+  char buffer[ 1 << 16 ];
+  std::string line;
+  while ( true )
+  {
+    bool stdinEnded = false;
+    for ( std::size_t i = 0; i < inputs.size(); ++i )
+    {
+      input_t &input = inputs[ i ];
+      // Open the new file before the old one is read to its end, so that nothing written to the old
+      // one before the new one appeared is missed
+      if ( input.replaced && input.successor < 0 )
+        input.successor = open( input.position->path.c_str(), O_RDONLY );
+
+      // Files never block, stdin is only read while something is waiting
+      ssize_t n = -1;
+      while ( ( input.position || readable( input.fd ) ) &&
+              ( n = read( input.fd, buffer, sizeof buffer ) ) > 0 )
+      {
+        input.pending.append( buffer, n );
+        std::string::size_type begin = 0, newline;
+        while ( ( newline = input.pending.find( '\n', begin ) ) != std::string::npos )
+        {
+          if ( skip )
+            --skip;
+          else
+          {
+            line.assign( input.pending, begin, newline - begin );
+            if ( snapshotRequested || checkpointRequested )
+              handleRequests( sink );
+            sink.add( line );
+            skip = sampler.skip();
+          }
+          if ( input.position )
+            input.position->offset += newline + 1 - begin;
+          begin = newline + 1;
+        }
+        input.pending.erase( 0, begin );
+      }
+      if ( n == 0 && fromStdin )
+      {
+        if ( !input.pending.empty() && !skip )
+          sink.add( input.pending );
+        stdinEnded = true;
+      }
+      else if ( n == 0 && input.successor >= 0 )
+      {
+        // The old file has been read to its end, go on with the new one
+        if ( !input.pending.empty() )
+          sink.add( input.pending );
+        inotify_rm_watch( notify, input.watch );
+        close( input.fd );
+        input.fd = input.successor;
+        input.watch = inotify_add_watch( notify, input.position->path.c_str(), watched );
+        input.replaced = false;
+        input.successor = -1;
+        input.pending.clear();
+        input.position->offset = 0;
+        --i; // read it right away
+      }
+      else if ( n == 0 )
+      {
+        // A file that got shorter has been truncated, start over
+        struct stat st;
+        if ( fstat( input.fd, &st ) == 0 && lseek( input.fd, 0, SEEK_CUR ) > st.st_size )
+        {
+          lseek( input.fd, 0, SEEK_SET );
+          input.pending.clear();
+          input.position->offset = 0;
+        }
+      }
+    }
+    if ( stdinEnded )
+    {
+      sink.report( std::cout );
+      return;
+    }
+    if ( snapshotRequested || checkpointRequested )
+      handleRequests( sink );
+
+    double now = monotonicSeconds();
+    if ( now >= next )
+    {
+      sink.report( std::cout );
+      std::cout.flush();
+      while ( next <= now )
+        next += followInterval;
+    }
+
+    if ( waitForInput( fromStdin ? 0 : notify, static_cast< int >( ( next - now ) * 1000 ) + 1 ) &&
+         !fromStdin )
+    {
+      // Which file has grown does not matter, all are read, but replaced files are noted
+      alignas( struct inotify_event ) char events[ 4096 ];
+      ssize_t length;
+      while ( ( length = read( notify, events, sizeof events ) ) > 0 )
+        for ( char *at = events; at < events + length; )
+        {
+          const struct inotify_event *event = reinterpret_cast< struct inotify_event * >( at );
+          if ( event->mask & ( IN_MOVE_SELF | IN_DELETE_SELF ) )
+            for ( std::size_t i = 0; i < inputs.size(); ++i )
+              if ( inputs[ i ].watch == event->wd )
+                inputs[ i ].replaced = true;
+          at += sizeof( struct inotify_event ) + event->len;
+        }
+    }
+  }
+}
+
+int main( int argc, char *argv[] )
+{
+  optionSetter[ "-h" ] = usage;
+  optionSetter[ "-a" ] = setForceAlphabetically;
+  optionSetter[ "-s" ] = setNoRepeatPrefix;
+  optionSetter[ "-f" ] = setPrependFrequency;
+  optionSetter[ "-F" ] = setAppendFrequency;
+  optionSetter[ "-p" ] = setParentheses;
+  optionSetter[ "-b" ] = setBash;
+  optionSetter[ "-g" ] = setGraphviz;
+  optionArgSetter[ "--distinct-field" ] = setDistinctField;
+  optionArgSetter[ "--distinct-threshold" ] = setDistinctThreshold;
+  optionArgSetter[ "--memory-cap" ] = setMemoryCap;
+  optionArgSetter[ "--memory-limit" ] = setMemoryLimit;
+  optionSetter[ "--partitioned" ] = setPartitioned;
+  optionSetter[ "--merge-sorted" ] = setMergeSorted;
+  optionSetter[ "--radix-sort" ] = setRadixSort;
+  optionArgSetter[ "--threads" ] = setThreads;
+  optionSetter[ "--stats" ] = setStats;
+  optionSetter[ "--relayout" ] = setRelayout;
+  optionArgSetter[ "--top" ] = setTop;
+  optionArgSetter[ "--min-depth" ] = setMinDepth;
+  optionArgSetter[ "--huge-pages" ] = setHugePages;
+  optionArgSetter[ "--numa" ] = setNuma;
+  optionArgSetter[ "--count-min" ] = setCountMin;
+  optionArgSetter[ "--count-min-depths" ] = setCountMinDepths;
+  optionArgSetter[ "--sample" ] = setSample;
+  optionSetter[ "--sample-ci" ] = setSampleConfidence;
+  optionArgSetter[ "--seed" ] = setSeed;
+  optionArgSetter[ "--time-field" ] = setTimeField;
+  optionArgSetter[ "--window" ] = setWindow;
+  optionArgSetter[ "--window-buckets" ] = setWindowBuckets;
+  optionArgSetter[ "--half-life" ] = setHalfLife;
+  optionSetter[ "--follow" ] = setFollow;
+  optionArgSetter[ "--interval" ] = setInterval;
+  optionArgSetter[ "--snapshot-file" ] = setSnapshotFile;
+  optionArgSetter[ "--checkpoint" ] = setCheckpoint;
+  optionArgSetter[ "--checkpoint-interval" ] = setCheckpointInterval;
+  optionArgSetter[ "--resume" ] = setResume;
+
+  int i;
+  for ( i = 1; i < argc; ++i )
+  {
+    if ( strcmp( argv[ i ], "--" ) == 0 )
+    {
+      // End of options
+      ++i;
+      break;
+    }
+    if ( optionSetter.count( argv[ i ] ) )
+      optionSetter[ argv[ i ] ]();
+    else if ( optionArgSetter.count( argv[ i ] ) )
+    {
+      if ( i + 1 == argc )
+        usage();
+      optionArgSetter[ argv[ i ] ]( argv[ i + 1 ] );
+      ++i;
+    }
+    else
+      break;
+  }
+
+  // A field is either the value or the time of a string
+  if ( distinctField && distinctField == timeField )
+    usage();
+
+  // Distinct counts and scores are shown next to the frequency
+  if ( ( distinctField || halfLife ) && !format.appendFrequency )
+    format.prependFrequency = true;
+
+  if ( sampleRate < 1 )
+    estimatedCounts = true;
+
+  nodeExtra_c::layOut();
+
+  // Unless asked to repeat a sample, every run takes another one
+  if ( !sampleSeedSet )
+  {
+    struct timespec now;
+    clock_gettime( CLOCK_REALTIME, &now );
+    sampleSeed = now.tv_sec * 1000000000ULL + now.tv_nsec;
+  }
+  sampler_c sampler( sampleSeed );
+
+  // Checkpoints, runs, partitions, merges and sorts only know about counts
+  const bool checkpoints = !checkpointFile.empty() || !resumeFile.empty();
+  if ( ( checkpoints || memoryLimit || partitioned || mergeSorted || radixSort ) &&
+       ( countMinSize || distinctField || halfLife || memoryCap || windowSeconds ) )
+    usage();
+  if ( ( memoryLimit || radixSort ) && checkpoints )
+    usage();
+  if ( radixSort && ( memoryLimit || partitioned || mergeSorted ) )
+    usage();
+  // The threads share one trie that only knows about counts
+  const bool concurrentTrie = threads > 1 && !radixSort;
+  if ( concurrentTrie && ( countMinSize || distinctField || halfLife || memoryCap || windowSeconds ||
+                           memoryLimit || checkpoints || followInputs || sampleRate < 1 ||
+                           snapshotFileSet ) )
+    usage();
+  // Only the plain trie is searched for the top nodes, which are listed one per line
+  if ( topCount && ( countMinSize || distinctField || halfLife || memoryCap || windowSeconds ||
+                     memoryLimit || partitioned || mergeSorted || radixSort || concurrentTrie ||
+                     checkpoints || followInputs || format.structureStyle != linewise ||
+                     !format.repeatPrefix || format.forceAlphabetically ) )
+    usage();
+  if ( minDepthSet && !topCount )
+    usage();
+  // Count-min keeps nothing but counts, and estimates even those
+  if ( countMinSize && ( distinctField || halfLife || memoryCap || windowSeconds ) )
+    usage();
+  // Partitions and merges read the files themselves
+  if ( ( partitioned || mergeSorted ) &&
+       ( partitioned == mergeSorted || concurrentTrie || memoryLimit || checkpoints ||
+         followInputs || sampleRate < 1 || i == argc ) )
+    usage();
+
+  for ( ; i < argc; ++i )
+  {
+    inputPosition_t position;
+    position.path = argv[ i ];
+    position.offset = 0;
+    inputPositions.push_back( position );
+  }
+
+  // Only regular files can be read again from where a checkpoint left off
+  if ( checkpoints && inputPositions.empty() )
+    usage();
+  for ( std::size_t file = 0; checkpoints && file < inputPositions.size(); ++file )
+  {
+    struct stat st;
+    if ( stat( inputPositions[ file ].path.c_str(), &st ) != 0 || !S_ISREG( st.st_mode ) )
+    {
+      std::cerr << "stree: " << inputPositions[ file ].path << " is not a regular file, which "
+                << "checkpoints need\n";
+      exit( 1 );
+    }
+  }
+
+  // Tries that do not drop nodes before the end take them from an arena. Neither is freed, as that
+  // would take about as long as building them, and the process is going to end anyway. Count-min
+  // builds a new trie for every report, which --follow asks for again and again, so its nodes are
+  // freed as usual.
+  std::pmr::memory_resource *arena = new std::pmr::monotonic_buffer_resource( chunkResource_c::bufferSize, &chunks );
+  if ( !memoryCap && !windowSeconds && !memoryLimit && !partitioned && !countMinSize )
+    nodeResource = arena;
+  extendedTrie_c &trie = *new extendedTrie_c;
+  if ( !resumeFile.empty() )
+    resume( resumeFile, trie.root() );
+
+  lineSink_c *sink;
+  if ( countMinSize )
+  {
+    sink = new countMinEngine_c( countMinSize );
+    estimatedCounts = true;
+  }
+  else if ( memoryLimit )
+    sink = new spillingSink_c( trie );
+  else if ( radixSort && threads > 1 )
+    sink = new parallelSortEngine_c;
+  else if ( radixSort )
+    sink = new radixSortEngine_c;
+  else if ( concurrentTrie )
+    sink = new concurrentTrieSink_c;
+  else if ( !distinctField && !halfLife && !windowSeconds && !memoryCap && !checkpoints && !followInputs )
+    sink = new countingTrieSink_c;
+  else
+    sink = new trieSink_c( trie );
+
+  // The threads of the shared trie never stop between two strings all at once
+  if ( pipe2( wakeUp, O_NONBLOCK | O_CLOEXEC ) != 0 )
+    wakeUp[ 0 ] = wakeUp[ 1 ] = -1;
+  signal( SIGUSR1, concurrentTrie ? SIG_IGN : requestSnapshot );
+  if ( !checkpointFile.empty() )
+  {
+    signal( SIGALRM, requestCheckpoint );
+    struct itimerval timer;
+    timer.it_interval.tv_sec = static_cast< time_t >( checkpointInterval );
+    timer.it_interval.tv_usec = static_cast< suseconds_t >(
+      ( checkpointInterval - timer.it_interval.tv_sec ) * 1e6 );
+    timer.it_value = timer.it_interval;
+    setitimer( ITIMER_REAL, &timer, 0 );
+  }
+
+  // Engines that read while writing count as writing only
+  const double start = monotonicSeconds();
+  double readingEnd = start;
+  if ( followInputs )
+    follow( *sink, sampler );
+  else if ( partitioned )
+    reportPartitioned( std::cout );
+  else if ( mergeSorted )
+    reportMerged( std::cout );
+  else
+  {
+    if ( inputPositions.empty() )
+    {
+      // read from stdin
+      readLines( 0, *sink, sampler );
+    }
+    else if ( concurrentTrie )
+      readInParallel( *sink, sampler );
+    else
+    {
+      for ( std::size_t file = 0; file < inputPositions.size(); ++file )
+        readFile( inputPositions[ file ], *sink, sampler );
+    }
+    if ( !checkpointFile.empty() )
+      finishCheckpoints( *sink );
+    readingEnd = monotonicSeconds();
+    sink->report( std::cout );
+  }
+  std::cout.flush();
+
+  if ( printStats )
+  {
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+    std::cerr << std::fixed << std::setprecision( 2 )
+              << "stree: reading " << readingEnd - start << " s, writing "
+              << monotonicSeconds() - readingEnd << " s, " << chunks.mapped() / 1048576
+              << " MiB of node arena, peak memory " << usage.ru_maxrss / 1024 << " MiB\n";
+    std::cerr << "stree: " << chunks.placement() << "\n";
+  }
+  // The sink is not deleted either, just like the trie
 }
@@ -0,0 +1,680 @@
+#ifndef STREE_H
+#define STREE_H
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+  libstree builds prefix tries from strings and writes them just like the stree command does.
+
+  Nothing in here is global: every trie is on its own and the way it is written is given by a
+  formatOptions_t, so independent tries may be built and written by different threads at the same
+  time.
+
+  The trie is a template in this header, so that each use is compiled for its own key unit, counter
+  and allocator. Writing trees is done by libstree.a.
+*/
+
+enum structureStyle_t
+{
+  linewise,
+  parentheses,
+  bash,
+  graphviz
+};
+
+/*
+  How a tree is written. The defaults are those of stree without any options, and the comments name
+  the options that change them.
+*/
+struct formatOptions_t
+{
+  bool forceAlphabetically;        // -a
+  bool repeatPrefix;               // -s clears it
+  bool prependFrequency;           // -f
+  bool appendFrequency;            // -F
+  structureStyle_t structureStyle; // -p, -b, -g
+
+  formatOptions_t()
+    : forceAlphabetically( false ), repeatPrefix( true ), prependFrequency( false ),
+      appendFrequency( false ), structureStyle( linewise ) {}
+
+  bool printFrequency() const { return prependFrequency || appendFrequency; }
+
+  // Children are written most frequent first, unless -a
+  bool sortByFrequency() const { return printFrequency() && !forceAlphabetically; }
+};
+
+/*
+  Writes a tree node by node: head() for each node, separator() between two children of a node and
+  tail() once all children of a node have been written.
+
+  'current' is the part of the string that the parent node has not written, 'prefix' is the rest.
+  'columns' are written as the frequency, usually just the count, but callers may add more, e.g. a
+  number of distinct values. Strings end at the node if 'terminal' is set.
+*/
+class treeFormatter_c
+{
+  std::ostream &_out;
+  const formatOptions_t &_options;
+
+public:
+  treeFormatter_c( std::ostream &out, const formatOptions_t &options ) : _out( out ), _options( options ) {}
+
+  void head( const std::string &current, const std::string &prefix,
+             const std::vector< std::string > &columns, bool isRootNode, bool hasChildren,
+             bool terminal );
+  void separator();
+  void tail( const std::string &current, bool isRootNode, bool hasChildren );
+};
+
+/*
+  A visitor is shown the nodes that would be written: the root, each string and each prefix after
+  which strings continue in different ways. The first node entered is the root, the children of a
+  node are entered between its enter() and leave(). 'count' is the number of strings that start
+  with prefix+current, 'terminal' the number of strings that are equal to it.
+*/
+template< typename unit_t >
+class basicTrieVisitor_c
+{
+public:
+  typedef std::basic_string< unit_t > string_t;
+
+  virtual ~basicTrieVisitor_c() {}
+
+  virtual void enter( const string_t &current, const string_t &prefix, unsigned long long count,
+                      unsigned long long terminal, std::size_t children ) = 0;
+  virtual void leave( const string_t &, const string_t & ) {}
+};
+
+typedef basicTrieVisitor_c< char > trieVisitor_c;
+
+/*
+  Writes the nodes it is shown with a treeFormatter_c. The frequency is the count, unless columns()
+  says otherwise.
+*/
+class formattingVisitor_c : public trieVisitor_c
+{
+protected:
+  treeFormatter_c _formatter;
+  const formatOptions_t &_options;
+  // For each node entered but not left: has it children, how many have been entered
+  std::vector< std::pair< bool, std::size_t > > _open;
+
+public:
+  formattingVisitor_c( std::ostream &out, const formatOptions_t &options )
+    : _formatter( out, options ), _options( options ) {}
+
+  virtual std::vector< std::string > columns( unsigned long long count ) const;
+
+  void enter( const std::string &current, const std::string &prefix, unsigned long long count,
+              unsigned long long terminal, std::size_t children );
+  void leave( const std::string &current, const std::string &prefix );
+};
+
+/*
+  Length of the common prefix of two strings.
+*/
+template< typename unit_t >
+std::size_t commonPrefix( const unit_t *lhs, std::size_t lhsLength, const unit_t *rhs, std::size_t rhsLength )
+{
+  const std::size_t length = std::min( lhsLength, rhsLength );
+  std::size_t i = 0;
+  while ( i < length && lhs[ i ] == rhs[ i ] )
+    ++i;
+  return i;
+}
+
+// Bytes are compared 16 at a time where possible
+inline std::size_t commonPrefix( const char *lhs, std::size_t lhsLength, const char *rhs, std::size_t rhsLength )
+{
+  const std::size_t length = std::min( lhsLength, rhsLength );
+  std::size_t i = 0;
+#ifdef __SSE2__
+  for ( ; i + 16 <= length; i += 16 )
+  {
+    const __m128i equal = _mm_cmpeq_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i* >( lhs + i ) ),
+                                          _mm_loadu_si128( reinterpret_cast< const __m128i* >( rhs + i ) ) );
+    const unsigned int mask = _mm_movemask_epi8( equal );
+    if ( mask != 0xffff )
+      return i + __builtin_ctz( ~mask );
+  }
+#endif
+  while ( i < length && lhs[ i ] == rhs[ i ] )
+    ++i;
+  return i;
+}
+
+/*
+  The children of the nodes on the way from the root to the one being written, each with the key it
+  is ordered by, e.g. its count. It is kept between nodes, so that ordering the children of a node
+  allocates nothing: each node puts its children at the end, orders them and removes them once done.
+
+  A trie that has been laid out by frequency and keeps the ranks of its nodes, see orderedExtra_t,
+  skips the sorting: its children go straight to their places.
+*/
+template< typename child_t >
+struct childOrder_t
+{
+  typedef std::pair< unsigned long long, child_t > entry_t;
+
+  std::vector< entry_t > children, scratch;
+  std::size_t histogram[ sizeof( unsigned long long ) ][ 256 ];
+
+  // Sort the children from 'begin' on by key, largest first. The sort is stable, so that equal keys
+  // stay in alphabetical order. A few children are sorted by insertion. Many are sorted by a radix
+  // sort on the bytes of their keys, least significant first, skipping the bytes that are the same
+  // for all.
+  void byKey( std::size_t begin )
+  {
+    const std::size_t n = children.size() - begin;
+    if ( n < 2 )
+      return;
+
+    entry_t *first = &children[ begin ];
+    if ( n < 64 )
+    {
+      for ( std::size_t i = 1; i < n; ++i )
+      {
+        const entry_t entry = first[ i ];
+        std::size_t j = i;
+        for ( ; j && first[ j - 1 ].first < entry.first; --j )
+          first[ j ] = first[ j - 1 ];
+        first[ j ] = entry;
+      }
+      return;
+    }
+
+    // Largest first is ascending order of the complement
+    const std::size_t bytes = sizeof( unsigned long long );
+    for ( std::size_t byte = 0; byte < bytes; ++byte )
+      std::fill( histogram[ byte ], histogram[ byte ] + 256, 0 );
+    for ( std::size_t i = 0; i < n; ++i )
+      for ( std::size_t byte = 0; byte < bytes; ++byte )
+        ++histogram[ byte ][ ~first[ i ].first >> 8 * byte & 0xff ];
+    scratch.resize( n );
+    for ( std::size_t byte = 0; byte < bytes; ++byte )
+    {
+      std::size_t *counts = histogram[ byte ];
+      if ( counts[ ~first[ 0 ].first >> 8 * byte & 0xff ] == n )
+        continue;
+      for ( std::size_t digit = 0, position = 0; digit < 256; ++digit )
+      {
+        const std::size_t count = counts[ digit ];
+        counts[ digit ] = position;
+        position += count;
+      }
+      for ( std::size_t i = 0; i < n; ++i )
+        scratch[ counts[ ~first[ i ].first >> 8 * byte & 0xff ]++ ] = first[ i ];
+      std::copy( scratch.begin(), scratch.begin() + n, first );
+    }
+  }
+};
+
+/*
+  The walk of basicTrie_c::visit(), for any trie that 'walker_t' describes, so that all tries show
+  their nodes to a visitor the same way. 'current' is the part of the node's string that its parent has not shown,
+  'prefix' is the rest. The walker has the types string_t, handle_t of a node and child_t of a child
+  together with its label, and
+    count( node ), node( child ) and label( child ),
+    onlyChild( node, child ): whether 'node' has exactly one child, which goes to 'child',
+    children( node, order ): put the children to show at the end of 'order.children' with the keys
+      that byFrequency() orders them by, and return the sum of their counts,
+    enter( node, current, prefix, count, terminal, children ) and leave( current, prefix ) of the
+      visitor,
+    descend( child, prefix, order ): show a child, usually by calling walkTrie() again.
+*/
+template< typename walker_t >
+void walkTrie( walker_t &walker, typename walker_t::handle_t node, typename walker_t::string_t current,
+               const typename walker_t::string_t &prefix, childOrder_t< typename walker_t::child_t > &order )
+{
+  // If there is just one non-optional continuation of the string, it is part of the same node
+  typename walker_t::child_t only = typename walker_t::child_t();
+  while ( walker.onlyChild( node, only ) && walker.count( walker.node( only ) ) == walker.count( node ) )
+  {
+    current += walker.label( only );
+    node = walker.node( only );
+  }
+
+  const std::size_t begin = order.children.size();
+  const unsigned long long terminal = walker.count( node ) - walker.children( node, order );
+  const std::size_t end = order.children.size();
+  if ( walker.byFrequency() )
+    order.byKey( begin );
+
+  walker.enter( node, current, prefix, walker.count( node ), terminal, end - begin );
+  // The children of each child are put behind, and gone again when it returns
+  for ( std::size_t i = begin; i < end; ++i )
+    walker.descend( order.children[ i ].second, prefix + current, order );
+  walker.leave( current, prefix );
+  order.children.resize( begin );
+}
+
+/*
+  What the nodes of a basicTrie_c carry besides their count, unless told otherwise: nothing.
+*/
+struct noExtra_t
+{
+};
+
+/*
+  Nodes that are an orderedExtra_t keep their place among their siblings in a copy laid out by
+  frequency, see basicTrie_c( from, byFrequency ). Visiting the copy by frequency then puts the
+  children at their places instead of sorting them again, until the trie changes. With a 32 bit
+  count, the rank goes into the padding before the children and takes no memory.
+*/
+struct orderedExtra_t
+{
+  orderedExtra_t() : rank( 0 ) {}
+
+  unsigned int rank;
+};
+
+/*
+  A prefix trie of strings of 'unit_t', e.g. char or char16_t for tokens. Each node counts its
+  strings in a 'count_t', which needs to support += and conversion to unsigned long long. The
+  children of all nodes are allocated by an 'allocator_t', which may be std::pmr::polymorphic_allocator
+  to take nodes from a memory resource given to the constructor.
+
+  Every node is also an 'extra_t', for users that keep more per node than the count, e.g. statistics
+  of their own. Those work on the nodes directly, starting from root(). An empty 'extra_t' takes no
+  memory.
+*/
+template< typename unit_t = char, typename count_t = unsigned long long,
+          template< typename > class allocator_t = std::allocator, typename extra_t = noExtra_t >
+class basicTrie_c
+{
+public:
+  typedef std::basic_string< unit_t > string_t;
+  typedef std::basic_string_view< unit_t > stringView_t;
+  typedef basicTrieVisitor_c< unit_t > visitor_t;
+
+  struct node_t;
+  typedef allocator_t< std::pair< const unit_t, node_t > > childAllocator_t;
+  typedef std::map< unit_t, node_t, std::less< unit_t >, childAllocator_t > children_t;
+  typedef typename children_t::const_iterator child_t;
+
+  struct node_t : public extra_t
+  {
+    // Allocators that support it hand themselves down to the children of new nodes
+    typedef childAllocator_t allocator_type;
+
+    count_t count;
+    children_t next;
+
+    node_t() : count() {}
+    explicit node_t( const allocator_type &allocator ) : count(), next( allocator ) {}
+  };
+
+private:
+  node_t _root;
+  // The last string inserted by a batch and its nodes from the root on, which the next batch can
+  // start from. Nodes never move, so these stay valid.
+  string_t _last;
+  std::vector< node_t* > _path;
+  // Whether the ranks of the nodes are their order by frequency
+  bool _ranked;
+
+  static const bool ranks = std::is_base_of< orderedExtra_t, extra_t >::value;
+
+  basicTrie_c( const basicTrie_c& );
+  basicTrie_c &operator=( const basicTrie_c& );
+
+  // Ask for the cache lines of 'node' that the next step is going to read
+  static void prefetch( const node_t *node )
+  {
+#ifdef __GNUC__
+    __builtin_prefetch( &node->count, 1 );
+    __builtin_prefetch( &node->next, 1 );
+#endif
+  }
+
+  static unsigned long long value( const node_t &node )
+  {
+    return static_cast< unsigned long long >( node.count );
+  }
+
+  // The children of the nodes on the way to the one being visited or copied, each with its count
+  typedef childOrder_t< child_t > order_t;
+
+  // Put the children of 'node' at the end of 'order.children', in the order they are visited.
+  // Returns where they start; the caller removes them once done.
+  static std::size_t ordered( const node_t &node, bool byFrequency, order_t &order )
+  {
+    typedef typename order_t::entry_t entry_t;
+    const std::size_t begin = order.children.size();
+    for ( child_t it = node.next.begin(); it != node.next.end(); ++it )
+      order.children.push_back( entry_t( value( it->second ), it ) );
+    if ( byFrequency )
+      order.byKey( begin );
+    return begin;
+  }
+
+  // How walkTrie() gets at the nodes for visit()
+  struct walker_t
+  {
+    typedef typename basicTrie_c::string_t string_t;
+    typedef const node_t *handle_t;
+    typedef typename basicTrie_c::child_t child_t;
+
+    visitor_t &visitor;
+    const bool sortByFrequency;
+    const bool ranked;
+
+    unsigned long long count( handle_t node ) const { return value( *node ); }
+    handle_t node( child_t child ) const { return &child->second; }
+    unit_t label( child_t child ) const { return child->first; }
+    bool byFrequency() const { return sortByFrequency && !ranked; }
+
+    bool onlyChild( handle_t node, child_t &child ) const
+    {
+      child = node->next.begin();
+      return node->next.size() == 1;
+    }
+
+    // Ranked children are put in order right away
+    unsigned long long children( handle_t node, order_t &order ) const
+    {
+      unsigned long long sum = 0;
+      if constexpr ( ranks )
+        if ( ranked )
+        {
+          const std::size_t begin = order.children.size();
+          order.children.resize( begin + node->next.size() );
+          for ( child_t it = node->next.begin(); it != node->next.end(); ++it )
+          {
+            order.children[ begin + it->second.rank ] = typename order_t::entry_t( value( it->second ), it );
+            sum += value( it->second );
+          }
+          return sum;
+        }
+      for ( std::size_t i = ordered( *node, false, order ); i < order.children.size(); ++i )
+        sum += order.children[ i ].first;
+      return sum;
+    }
+
+    void enter( handle_t, const string_t &current, const string_t &prefix, unsigned long long count,
+                unsigned long long terminal, std::size_t children )
+    {
+      visitor.enter( current, prefix, count, terminal, children );
+    }
+    void leave( const string_t &current, const string_t &prefix ) { visitor.leave( current, prefix ); }
+
+    void descend( child_t child, const string_t &prefix, order_t &order )
+    {
+      walkTrie( *this, &child->second, string_t( 1, child->first ), prefix, order );
+    }
+  };
+
+  // A new child 'c' of 'node', which is known not to have it yet. It goes at the end if the
+  // children are added in order.
+  static node_t &append( node_t &node, unit_t c )
+  {
+    return node.next.emplace_hint( node.next.end(), std::piecewise_construct, std::forward_as_tuple( c ),
+                                   std::forward_as_tuple() )->second;
+  }
+
+  // Copy the subtree of 'from' to 'to', taking the nodes in the order that visit() reads them
+  static void copy( const node_t &from, node_t &to, bool byFrequency, order_t &order )
+  {
+    // Chains of only children are followed without recursing, as they may be as long as a string
+    const node_t *source = &from;
+    node_t *target = &to;
+    target->count += value( *source );
+    while ( source->next.size() == 1 )
+    {
+      target = &append( *target, source->next.begin()->first );
+      source = &source->next.begin()->second;
+      target->count += value( *source );
+    }
+
+    const std::size_t begin = ordered( *source, byFrequency, order ), end = order.children.size();
+    for ( std::size_t i = begin; i < end; ++i )
+    {
+      const child_t child = order.children[ i ].second;
+      node_t &copied = append( *target, child->first );
+      if constexpr ( ranks )
+        copied.rank = i - begin;
+      copy( child->second, copied, byFrequency, order );
+    }
+    order.children.resize( begin );
+  }
+
+public:
+  basicTrie_c( const childAllocator_t &allocator = childAllocator_t() )
+    : _root( allocator ), _path( 1, &_root ), _ranked( false ) {}
+
+  // A copy of 'from' with nodes from 'allocator', laid out in the order that visit() with
+  // 'byFrequency' goes through them. Visiting the copy then reads memory mostly from front to back
+  // instead of in the order the strings came in. With orderedExtra_t nodes, it need not sort the
+  // children either.
+  basicTrie_c( const basicTrie_c &from, bool byFrequency,
+               const childAllocator_t &allocator = childAllocator_t() )
+    : _root( allocator ), _path( 1, &_root ), _ranked( ranks && byFrequency )
+  {
+    order_t order;
+    copy( from._root, _root, byFrequency, order );
+  }
+
+  ~basicTrie_c() { removeChildren( _root ); }
+
+  // Remove the nodes below 'node', leaving its count as it is. They are destroyed leaves first, one
+  // at a time, rather than by the destructors of their maps, which would recurse once per unit of
+  // the longest string.
+  void removeChildren( node_t &node )
+  {
+    std::vector< node_t* > path( 1, &node );
+    while ( true )
+    {
+      node_t *last = path.back();
+      if ( !last->next.empty() )
+      {
+        path.push_back( &last->next.begin()->second );
+        continue;
+      }
+      path.pop_back();
+      if ( path.empty() )
+        break;
+      path.back()->next.erase( path.back()->next.begin() );
+    }
+    // The next batch starts from the root again
+    _last.clear();
+    _path.resize( 1 );
+    _ranked = false;
+  }
+
+  // The root, whose count is the number of strings. Whatever is changed through it may change the
+  // order or remove the nodes that the next insert( strings, n ) would go on from, so the ranks are
+  // not used anymore and the next batch starts from the root again. The reference is meant for
+  // changes before the next insert.
+  node_t &root()
+  {
+    _ranked = false;
+    _last.clear();
+    _path.resize( 1 );
+    return _root;
+  }
+  const node_t &root() const { return _root; }
+
+  // Count 's' 'weight' times
+  void insert( stringView_t s, unsigned long long weight = 1 )
+  {
+    _ranked = false;
+    node_t *current = &_root;
+    current->count += weight;
+    for ( std::size_t i = 0; i < s.length(); ++i )
+    {
+      current = &current->next[ s[ i ] ];
+      current->count += weight;
+    }
+  }
+
+  // Count each of the 'n' 'strings' once. They go down the trie side by side, one level at a time:
+  // while the next node of one string is being fetched from memory, the others are looked up. This
+  // hides much of the waiting in tries that are larger than the caches.
+  //
+  // Consecutive strings often start the same, e.g. lines of a log. As far as a string shares its
+  // prefix with the one before, it takes the nodes that one has just been given instead of looking
+  // them up again.
+  void insert( const stringView_t *strings, std::size_t n )
+  {
+    const std::size_t group = 16;
+    _ranked = false;
+    for ( ; n; strings += std::min( n, group ), n -= std::min( n, group ) )
+    {
+      node_t *current[ group ];
+      std::size_t active[ group ], shared[ group ], size = std::min( n, group );
+      for ( std::size_t i = 0; i < size; ++i )
+      {
+        current[ i ] = &_root;
+        active[ i ] = i;
+        const stringView_t previous = i ? strings[ i - 1 ] : stringView_t( _last );
+        shared[ i ] = commonPrefix( previous.data(), previous.length(), strings[ i ].data(), strings[ i ].length() );
+      }
+      const std::size_t last = size - 1;
+      if ( _path.size() <= strings[ last ].length() )
+        _path.resize( strings[ last ].length() + 1 );
+
+      for ( std::size_t depth = 0; size; ++depth )
+      {
+        std::size_t left = 0;
+        for ( std::size_t k = 0; k < size; ++k )
+        {
+          // The string before is still active wherever they are the same, and has just moved on
+          const std::size_t i = active[ k ];
+          current[ i ]->count += 1;
+          if ( depth == strings[ i ].length() )
+            continue;
+          if ( depth < shared[ i ] )
+            current[ i ] = i ? current[ i - 1 ] : _path[ depth + 1 ];
+          else
+          {
+            current[ i ] = &current[ i ]->next[ strings[ i ][ depth ] ];
+            prefetch( current[ i ] );
+          }
+          if ( i == last )
+            _path[ depth + 1 ] = current[ i ];
+          active[ left++ ] = i;
+        }
+        size = left;
+      }
+      _last.assign( strings[ last ] );
+    }
+  }
+
+  // The number of strings starting with 'prefix'
+  unsigned long long count( stringView_t prefix = stringView_t() ) const
+  {
+    const node_t *current = &_root;
+    for ( std::size_t i = 0; i < prefix.length(); ++i )
+    {
+      child_t it = current->next.find( prefix[ i ] );
+      if ( it == current->next.end() )
+        return 0;
+      current = &it->second;
+    }
+    return value( *current );
+  }
+
+  // Visit the nodes in alphabetical order, or with the most frequent children first
+  void visit( visitor_t &visitor, bool byFrequency = false ) const
+  {
+    order_t order;
+    walker_t walker = { visitor, byFrequency, byFrequency && _ranked };
+    if ( value( _root ) )
+      walkTrie( walker, &_root, string_t(), string_t(), order );
+  }
+
+  // The 'k' most frequent of the nodes that visit() shows whose strings are at least 'minLength'
+  // long, as their strings and counts. The most frequent come first, equal counts in alphabetical
+  // order.
+  //
+  // No node comes before its parent in that order, so the nodes are searched best first: the next
+  // one is always the best among the children of those taken so far. Once 'k' nodes that are long
+  // enough have been seen, subtrees whose root comes after the last of them can not make it and are
+  // not entered.
+  std::vector< std::pair< string_t, unsigned long long > > top( std::size_t k,
+                                                                std::size_t minLength = 1 ) const
+  {
+    struct candidate_t
+    {
+      unsigned long long count;
+      string_t s;
+      const node_t *node;
+
+      // Whether this comes after 'other'
+      bool operator<( const candidate_t &other ) const
+      {
+        if ( count != other.count )
+          return count < other.count;
+        return std::lexicographical_compare( other.s.begin(), other.s.end(), s.begin(), s.end() );
+      }
+    };
+    struct firstOnTop_t
+    {
+      bool operator()( const candidate_t &lhs, const candidate_t &rhs ) const { return rhs < lhs; }
+    };
+
+    std::vector< std::pair< string_t, unsigned long long > > result;
+    std::priority_queue< candidate_t > frontier;
+    // The first 'k' nodes seen that are long enough, the last of them on top
+    std::priority_queue< candidate_t, std::vector< candidate_t >, firstOnTop_t > best;
+
+    const candidate_t root = { value( _root ), string_t(), &_root };
+    if ( k && root.count )
+      frontier.push( root );
+    while ( !frontier.empty() && result.size() < k )
+    {
+      const candidate_t taken = frontier.top();
+      frontier.pop();
+      if ( taken.node != &_root && taken.s.length() >= minLength )
+        result.push_back( std::make_pair( taken.s, taken.count ) );
+
+      for ( child_t it = taken.node->next.begin(); it != taken.node->next.end(); ++it )
+      {
+        // Nothing below comes before the child, as it counts at most as much and starts with it
+        candidate_t child = { value( it->second ), taken.s + it->first, &it->second };
+        if ( best.size() == k && child < best.top() )
+          continue;
+
+        // The same as visit(), an only child with the same count is part of the node
+        while ( child.node->next.size() == 1 && value( child.node->next.begin()->second ) == child.count )
+        {
+          child.s += child.node->next.begin()->first;
+          child.node = &child.node->next.begin()->second;
+        }
+        if ( child.s.length() >= minLength )
+        {
+          best.push( child );
+          if ( best.size() > k )
+            best.pop();
+        }
+        frontier.push( child );
+      }
+    }
+    return result;
+  }
+
+  void write( std::ostream &out, const formatOptions_t &options = formatOptions_t() ) const
+  {
+    static_assert( std::is_same< unit_t, char >::value, "only tries of char can be written" );
+    formattingVisitor_c formatter( out, options );
+    visit( formatter, options.sortByFrequency() );
+  }
+};
+
+typedef basicTrie_c<> trie_c;
+
+#endif
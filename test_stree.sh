@@ -11,6 +11,14 @@ oneTimeTearDown() {
   rm input
 }
 
+# Wait up to 10 seconds until the last tree written to file $1 is $2
+waitForTree() {
+  for i in $(seq 100); do
+    [ "$(tail -n $(( $(echo "$2" | wc -l) + 1 )) "$1")" = "$2" ] && return
+    sleep 0.1
+  done
+}
+
 testBasic() {
   assertEquals "
 ba
@@ -111,4 +119,489 @@ testBash() {
   assertEquals "digraph {ba -> {r;z};foo}" "$(./stree -g -s input)"
 }
 
+testDistinctField() {
+  cat > hits <<EOF
+10.0.0.1 /a
+10.0.0.2 /a
+10.0.0.1 /a
+10.0.0.1 /b
+EOF
+  assertEquals \
+"4        2        /
+3        2        /a
+1        1        /b" "$(./stree --distinct-field 1 hits)"
+  assertEquals \
+"/ 4 2
+/a 3 2
+/b 1 1" "$(./stree -F --distinct-field 1 hits)"
+
+  # Fields and thresholds are whole numbers from 1 on
+  assertEquals "NAME" "$(./stree --distinct-field 1x hits 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --distinct-field -1 hits 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --distinct-field 1 --distinct-threshold 0 hits 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --distinct-field 1 --distinct-threshold 4294967296 hits 2>&1 | head -n 1)"
+  rm hits
+}
+
+testMemoryCap() {
+  for i in $(seq 200); do echo aaaa; echo "ab$((i%7))"; done > heavy
+  seq 300 | sed 's/^/x/' >> heavy
+  # Frequent prefixes survive with exact counts, rare ones are dropped or marked
+  assertEquals "aaaa 200" "$(./stree -F --memory-cap 3K heavy | grep aaaa)"
+  assertEquals "ab 200"   "$(./stree -F --memory-cap 3K heavy | grep '^ab ')"
+  assertEquals "x1 100+11" "$(./stree -F --memory-cap 3K heavy | grep '^x1 ')"
+  # Sampled, the error is scaled up just like the count
+  assertEquals "x1 ~96+16" "$(./stree -F --memory-cap 3K --sample 0.5 --seed 24301 heavy | grep '^x1 ')"
+  rm heavy
+  # The distinct values kept by the nodes count against the cap as well
+  for i in $(seq 2000); do echo "10.0.$((i%250)).$((i%7)) /p$((i%40))"; done > hits
+  assertEquals "/p 2000" "$(./stree -F --memory-cap 8K --distinct-field 1 hits | cut -d ' ' -f 1,2 | head -n 1)"
+  assertEquals "yes" "$(./stree -F --memory-cap 8K --distinct-field 1 hits | grep -q '^/p[0-9]* [0-9]*+' && echo yes)"
+  rm hits
+  # A long string is dropped without running out of stack
+  head -c 300000 /dev/zero | tr '\0' a > long
+  printf '\nb\nb\n' >> long
+  assertEquals "b 2+1" "$(./stree -F --memory-cap 1M long | grep '^b')"
+  rm long
+}
+
+testCountMin() {
+  assertEquals \
+"3
+ba ~2
+bar ~1
+baz ~1
+foo ~1" "$(./stree -F --count-min 64K --count-min-depths 1,2,3 input 2>/dev/null)"
+  # Prefixes of other depths are not counted, so they are not reported either
+  assertEquals \
+"3
+b ~2
+bar ~1
+baz ~1
+foo ~1" "$(./stree -F --count-min 64K --count-min-depths 1,3 input 2>/dev/null)"
+  assertEquals "NAME" "$(./stree --count-min 64K --distinct-field 1 input 2>&1 | head -n 1)"
+  # Depths are whole numbers from 1 on, without signs, spaces or empty entries
+  for depths in +2 " 2" 99999999999999999999 0 1,,2 1, ""; do
+    assertEquals "NAME" "$(./stree --count-min 64K --count-min-depths "$depths" input 2>&1 | head -n 1)"
+  done
+}
+
+testSample() {
+  assertEquals "$(./stree -f input)" "$(./stree -f --sample 1 input)"
+  assertEquals "NAME" "$(./stree --sample 0.5x input 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --sample nan input 2>&1 | head -n 1)"
+  seq 1000 > numbers
+  # Every line carries a scaled count and its confidence interval
+  assertEquals "" "$(./stree -f --sample 0.5 --sample-ci numbers | grep -v '^~[0-9]*+-[0-9]*')"
+  # The same seed gives the same sample, and each file gets a sample of its own
+  assertEquals "$(./stree -f --sample 0.5 --seed 7 numbers)" "$(./stree -f --sample 0.5 --seed 7 numbers)"
+  # Were the files sampled alike, every string picked would be picked from both
+  assertEquals "yes" "$(./stree -F --sample 0.5 --seed 7 numbers numbers | grep -q '^[0-9]* ~2$' && echo yes)"
+  assertEquals "NAME" "$(./stree --sample 0.5 --seed -1 numbers 2>&1 | head -n 1)"
+  rm numbers
+}
+
+testWindow() {
+  cat > requests <<EOF
+100 /a
+101 /b
+200 /a
+205 /c
+EOF
+  # Only the strings of the last minute before the latest time are left
+  assertEquals \
+"/ 2
+/a 1
+/c 1" "$(./stree -F --window 60 --time-field 1 requests)"
+  cat > requests <<EOF
+-300 /a
+-250 /b
+-200 /a
+-195 /c
+EOF
+  # Times before the epoch slide the same way
+  assertEquals \
+"/ 3
+/a 1
+/b 1
+/c 1" "$(./stree -F --window 60 --time-field 1 requests)"
+  # Times that are no finite decimal number, or too far out for a window, are no times
+  printf 'nan /x\ninf /x\n-inf /x\n1e300 /x\n0x10 /x\n1e18 /x\n' >> requests
+  assertEquals "/c 1" "$(./stree -F --window 0.000001 --window-buckets 1 --time-field 1 requests)"
+
+  assertEquals "NAME" "$(./stree --window 60s requests 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --window 60 --window-buckets 10x requests 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --window 60 --time-field 1.5 requests 2>&1 | head -n 1)"
+  # The time is not a value at the same time
+  assertEquals "NAME" "$(./stree --window 60 --time-field 1 --distinct-field 1 requests 2>&1 | head -n 1)"
+  rm requests
+
+  # Long strings are expired and removed without running out of stack
+  head -c 200000 /dev/zero | tr '\0' a > long
+  assertEquals "$(./stree -f long | md5sum)" "$(./stree -f --window 1000 long | md5sum)"
+  { printf '5 '; cat long; printf '\n5000 b\n'; } > requests
+  assertEquals "b 1" "$(./stree -F --window 1000 --time-field 1 requests)"
+  rm long requests
+}
+
+testHalfLife() {
+  cat > requests <<EOF
+0 /a
+0 /a
+100 /b
+EOF
+  # The recent string is trending, although it is less frequent
+  assertEquals \
+"/ 3 1.5
+/b 1 1.0
+/a 2 0.5" "$(./stree -F --half-life 50 --time-field 1 requests)"
+  # A time that is no finite number, or absurdly late, does not decay all other scores to nothing
+  printf 'inf /c\n1e300 /c\nnan /c\n' >> requests
+  assertEquals \
+"/ 3 1.5
+/b 1 1.0
+/a 2 0.5" "$(./stree -F --half-life 50 --time-field 1 requests)"
+  assertEquals "NAME" "$(./stree --half-life 1h --time-field 1 requests 2>&1 | head -n 1)"
+  rm requests
+}
+
+testFollow() {
+  # stdin is read until it ends
+  assertEquals "$(./stree -f input)" "$(./stree -f --follow --interval 0.1 < input)"
+  assertEquals "NAME" "$(./stree --follow --interval 0.1s input 2>&1 | head -n 1)"
+
+  printf 'foo\nbar\n' > growing
+  ./stree -F --follow --interval 0.1 growing > snapshots &
+  waitForTree snapshots "2
+bar 1
+foo 1"
+  printf 'baz\n' >> growing
+  expected="3
+ba 2
+bar 1
+baz 1
+foo 1"
+  waitForTree snapshots "$expected"
+  assertEquals "$expected" "$(tail -n 6 snapshots)"
+
+  # After log rotation, the old file is read to its end and the new one followed
+  mv growing rotated
+  printf 'end\n' >> rotated
+  printf 'qux\n' > growing
+  expected="5
+ba 2
+bar 1
+baz 1
+end 1
+foo 1
+qux 1"
+  waitForTree snapshots "$expected"
+  kill $!
+  assertEquals "$expected" "$(tail -n 8 snapshots)"
+  rm growing rotated snapshots
+
+  # Changes deep down are written, whatever is copied from the report before
+  printf 'foobar\nfoobaz\nfoxtrot\nqux\n' > growing
+  ./stree -F --follow --interval 0.1 growing > snapshots &
+  waitForTree snapshots "$(./stree -F growing)"
+  printf 'foobarr\nfoxtrox\n' >> growing
+  expected="$(./stree -F growing)"
+  waitForTree snapshots "$expected"
+  kill $!
+  assertEquals "$expected" "$(tail -n $(( $(echo "$expected" | wc -l) + 1 )) snapshots)"
+  rm growing snapshots
+}
+
+testSnapshot() {
+  mkfifo strings
+  # SIGUSR1 is ignored until stree handles it
+  ( trap '' USR1; exec ./stree -F --snapshot-file snapshot < strings > /dev/null ) &
+  exec 3> strings
+  printf 'foo\nbar\n' >&3
+  # The snapshot is taken while stree waits for the next string
+  expected="2
+bar 1
+foo 1"
+  for i in $(seq 100); do
+    kill -USR1 $!
+    sleep 0.1
+    [ "$(cat snapshot 2> /dev/null)" = "$expected" ] && break
+  done
+  assertEquals "$expected" "$(cat snapshot)"
+  exec 3>&-
+  wait $!
+  rm strings snapshot
+
+  # The threads of the shared trie can not take snapshots
+  assertEquals "NAME" "$(./stree --threads 2 --snapshot-file snapshot input 2>&1 | head -n 1)"
+}
+
+testCheckpoint() {
+  seq 100000 > numbers
+  seq 200000 > all
+  ./stree --checkpoint checkpoint numbers > /dev/null
+  seq 100001 200000 >> numbers
+  # The last checkpoint covers all input read, resuming adds only what has been appended since
+  assertEquals "$(./stree -f all)" "$(./stree -f --resume checkpoint numbers)"
+  assertEquals "$(./stree -f all)" "$(./stree -f --resume checkpoint --checkpoint checkpoint numbers)"
+  assertEquals "$(./stree -f all)" "$(./stree -f --resume checkpoint numbers)"
+
+  # Files are known by what they are, not by their name, and have to be the same
+  assertEquals "$(./stree -f all)" "$(./stree -f --resume checkpoint ./numbers)"
+  assertEquals "stree: input is not in checkpoint checkpoint" \
+               "$(./stree --resume checkpoint numbers input 2>&1)"
+  assertEquals "stree: numbers of checkpoint checkpoint is not given" \
+               "$(./stree --resume checkpoint input 2>&1)"
+
+  assertEquals "NAME" "$(./stree --checkpoint checkpoint --checkpoint-interval 5m numbers 2>&1 | head -n 1)"
+
+  # Where stdin or a pipe left off is not known
+  assertEquals "NAME" "$(./stree --checkpoint checkpoint < numbers 2>&1 | head -n 1)"
+  assertEquals "stree: /dev/stdin is not a regular file, which checkpoints need" \
+               "$(cat numbers | ./stree --checkpoint checkpoint /dev/stdin 2>&1)"
+
+  # Long strings are saved and loaded without running out of stack, cut short they are no checkpoint
+  head -c 300000 /dev/zero | tr '\0' a > long
+  printf '\nb\n' >> long
+  ./stree --checkpoint checkpoint long > /dev/null
+  assertEquals "$(./stree -f long | md5sum)" "$(./stree -f --resume checkpoint long | md5sum)"
+  head -c 1000 checkpoint > broken
+  assertEquals "stree: broken is not a checkpoint" "$(./stree --resume broken long 2>&1)"
+  rm numbers all checkpoint long broken
+}
+
+testWideCounts() {
+  # A checkpoint whose only string has been counted 2^32-1 times, one more needs 64 bits
+  printf 'stree checkpoint 1\n1\n0 more\n\377\377\377\377\017\001a\377\377\377\377\017\000' > checkpoint
+  echo a > more
+  echo b > other
+  assertEquals "a 4294967296" "$(./stree -F --resume checkpoint more)"
+  printf 'stree checkpoint 1\n3\n0 more\n0 more\n0 other\n\377\377\377\377\017\001a\377\377\377\377\017\000' > checkpoint
+  assertEquals \
+"4294967298
+a 4294967297
+b 1" "$(./stree -F --resume checkpoint more more other)"
+  rm checkpoint more other
+}
+
+testMemoryLimit() {
+  seq 5000 > numbers
+  # Merging the runs gives the same tree as building it in memory
+  assertEquals "$(./stree -s numbers)"    "$(./stree -s --memory-limit 8K numbers)"
+  assertEquals "$(./stree -F -a numbers)" "$(./stree -F --memory-limit 8K numbers)"
+
+  # Children are ordered by frequency as well
+  seq 2000 | sed "s/.*/y1/" >> numbers
+  assertEquals "$(./stree -F numbers)" "$(./stree -F --memory-limit 8K numbers)"
+
+  # Long strings do not take as deep a recursion
+  head -c 200000 /dev/zero | tr '\0' a > long
+  printf '\nb\n' >> long
+  assertEquals "$(./stree -f long | md5sum)" "$(./stree -f --memory-limit 8K long | md5sum)"
+  rm long
+
+  # Sizes are digits only and have to fit
+  assertEquals "NAME" "$(./stree --memory-limit -1 numbers 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --memory-limit ' 8K' numbers 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --memory-limit 18014398509481984K numbers 2>&1 | head -n 1)"
+  rm numbers
+}
+
+testPartitioned() {
+  seq 5000 > numbers
+  # Building one first character at a time gives the same tree
+  assertEquals "$(./stree -f numbers input)"   "$(./stree -f --partitioned numbers input)"
+  assertEquals "$(./stree -b -s numbers)"      "$(./stree -b -s --partitioned numbers)"
+
+  # Long strings do not take as deep a recursion
+  head -c 200000 /dev/zero | tr '\0' a > long
+  echo b >> long
+  assertEquals "$(./stree -f long | md5sum)" "$(./stree -f --partitioned long | md5sum)"
+  rm numbers long
+}
+
+testMergeSorted() {
+  seq 1000 | LC_ALL=C sort > numbers
+  printf 'bar\nfoo\nfoo\n' > sorted
+  # Merging sorted files gives the same tree as reading them one after another
+  assertEquals "$(./stree -F -s numbers sorted)" "$(./stree -F -s --merge-sorted numbers sorted)"
+  assertEquals "stree: input is not sorted" "$(./stree --merge-sorted input 2>&1)"
+
+  # Sorted by unsigned bytes, the tree still comes in the usual order
+  printf 'abc\nzzz\n\303\251t\303\251\n\303\240\nab\n' | LC_ALL=C sort > bytes
+  assertEquals "$(./stree -F bytes)" "$(./stree -F --merge-sorted bytes)"
+  assertEquals "$(./stree -p numbers bytes)" "$(./stree -p --merge-sorted numbers bytes)"
+
+  # Children are ordered by frequency as well
+  seq 2000 | sed "s/.*/y1/" > frequent
+  assertEquals "$(./stree -F numbers bytes frequent)" "$(./stree -F --merge-sorted numbers bytes frequent)"
+  rm numbers sorted bytes frequent
+}
+
+testRadixSort() {
+  seq 5000 > numbers
+  # Sorting visits the same prefixes as the trie, with the same counts
+  assertEquals "$(./stree -f numbers input)" "$(./stree -f --radix-sort numbers input)"
+  assertEquals "$(./stree -p -s numbers)"    "$(./stree -p -s --radix-sort numbers)"
+  rm numbers
+}
+
+testParallelSort() {
+  seq 5000 > numbers
+  assertEquals "$(./stree -f numbers input)" "$(./stree -f --radix-sort --threads 4 numbers input)"
+  assertEquals "$(./stree -b -s numbers)"    "$(./stree -b -s --radix-sort --threads 3 numbers)"
+  rm numbers
+}
+
+testThreads() {
+  seq 20000 > numbers
+  # Parts of the files are entered into one trie by several threads
+  assertEquals "$(./stree -f numbers input)" "$(./stree -f --threads 4 numbers input)"
+  assertEquals "$(./stree -F -s numbers)"    "$(./stree -F -s --threads 3 < numbers)"
+  assertEquals "NAME" "$(./stree --threads -1 numbers 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --threads 2x numbers 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --threads +2 numbers 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --threads ' 2' numbers 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --threads 1000000 numbers 2>&1 | head -n 1)"
+  rm numbers
+}
+
+testStats() {
+  assertEquals "$(./stree -f input)" "$(./stree -f --stats input 2>/dev/null)"
+  assertEquals "stree: reading" "$(./stree --stats input 2>&1 >/dev/null | head -n 1 | cut -c1-14)"
+}
+
+testPlacement() {
+  seq 20000 > numbers
+  # Placing the nodes differently does not change the tree
+  assertEquals "$(./stree -f numbers)" "$(./stree -f --huge-pages transparent --numa local numbers)"
+  assertEquals "$(./stree -f numbers)" \
+               "$(./stree -f --huge-pages explicit --numa interleave --threads 2 numbers)"
+  assertEquals "1" \
+               "$(./stree --huge-pages transparent --stats numbers 2>&1 >/dev/null | grep -c 'by NUMA node')"
+  rm numbers
+}
+
+testManyChildren() {
+  for i in $(seq 33 126); do
+    for j in $(seq $(( i % 5 + 1 ))); do printf "\\$(printf %o $i)\n"; done
+  done > fanout
+  # Children with equal counts stay in alphabetical order, however many there are
+  assertEquals "$(./stree -F -a fanout | tail -n +2 | LC_ALL=C sort -s -k2,2nr)" \
+               "$(./stree -F fanout | tail -n +2)"
+  rm fanout
+}
+
+testTop() {
+  cat > paths <<EOF
+/a/x
+/a/x
+/a/y
+/b
+/b/x
+/c/xyz
+EOF
+  # The most frequent nodes of the tree, equal counts alphabetically
+  assertEquals \
+"6        /
+3        /a/
+2        /a/x
+2        /b" "$(./stree --top 4 paths)"
+  assertEquals \
+"/a/x 2
+/a/y 1
+/b/x 1" "$(./stree -F --top 3 --min-depth 4 paths)"
+  assertEquals "NAME" "$(./stree --top -1 paths 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --top 3x paths 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree --top 3 --min-depth -2 paths 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree -p --top 3 paths 2>&1 | head -n 1)"
+  assertEquals "NAME" "$(./stree -s --top 3 paths 2>&1 | head -n 1)"
+  rm paths
+}
+
+testRelayout() {
+  seq 5000 > numbers
+  # The copy has the same nodes, in whichever order they are written
+  assertEquals "$(./stree -f numbers input)" "$(./stree -f --relayout numbers input)"
+  assertEquals "$(./stree -p -s numbers)"    "$(./stree -p -s --relayout numbers)"
+  rm numbers
+}
+
+testLibrary() {
+  cat > library.cpp <<EOF
+#include "src/stree.h"
+#include <iostream>
+#include <memory_resource>
+int main()
+{
+  std::pmr::monotonic_buffer_resource arena;
+  basicTrie_c< char16_t, unsigned int, std::pmr::polymorphic_allocator > tokens( &arena );
+  tokens.insert( u"ab" );
+  tokens.insert( u"ac", 2 );
+  std::cout << tokens.count( u"a" ) << "\n";
+  std::u16string_view batch[] = { u"ab", u"b", u"" };
+  tokens.insert( batch, 3 );
+  std::cout << tokens.count( u"ab" ) << " " << tokens.count() << "\n";
+  std::u16string_view shared[] = { u"ab", u"b", u"abc" }, next[] = { u"abd" };
+  tokens.insert( shared, 3 );
+  tokens.insert( next, 1 );
+  std::cout << tokens.count( u"ab" ) << " " << tokens.count( u"abc" ) << " " << tokens.count() << "\n";
+
+  // Nodes may carry more than their count
+  struct seen_t { bool seen = false; };
+  basicTrie_c< char, unsigned long long, std::allocator, seen_t > extended;
+  extended.insert( "ab" );
+  extended.root().next.begin()->second.seen = true;
+  std::cout << extended.root().next.at( 'a' ).seen << " " << extended.root().next.at( 'a' ).count << "\n";
+  // Nodes removed through the root are not gone on from by the next batch
+  std::string_view strings[] = { "abc", "abd" };
+  extended.insert( strings, 2 );
+  extended.root().next.at( 'a' ).next.clear();
+  extended.insert( strings, 2 );
+  std::cout << extended.count( "ab" ) << " " << extended.count( "abd" ) << "\n";
+
+  // A copy laid out by frequency writes its nodes in the order they were copied in, until it changes
+  formatOptions_t options;
+  options.appendFrequency = true;
+  typedef basicTrie_c< char, unsigned int, std::allocator, orderedExtra_t > orderedTrie_c;
+  orderedTrie_c unordered;
+  unordered.insert( "x" );
+  unordered.insert( "y", 2 );
+  orderedTrie_c ordered( unordered, true );
+  ordered.write( std::cout, options );
+  ordered.insert( "x", 2 );
+  ordered.write( std::cout, options );
+
+  trie_c trie;
+  trie.insert( "foo" );
+  trie.insert( "bar" );
+  trie.insert( "baz", 2 );
+  std::cout << trie.count( "ba" ) << "\n";
+  trie.write( std::cout, options );
+}
+EOF
+  g++ -std=c++17 -o library library.cpp libstree.a
+  assertEquals \
+"3
+2 6
+5 1 10
+1 1
+2 1
+3
+y 2
+x 1
+
+5
+x 3
+y 2
+
+3
+4
+ba 3
+baz 2
+bar 1
+foo 1" "$(./library)"
+  rm library library.cpp
+}
+
 . shunit2